@@ -107,12 +107,57 @@ void bwrite(struct buf *b) {
     iderw(b);
 }
 
+// Start reading block blockno into the cache, unless it is there
+// already, and return without waiting for the disk, which unlocks
+// the buffer when it is done (see ideasync). A later bread() of
+// the block waits for it then. Read-ahead always leaves
+// MAXOPBLOCKS buffers free, so that it can never starve the log
+// or make bget() run out. Returns 0, or -1 if there was no
+// buffer to spare.
+int breadahead(uint dev, uint blockno) {
+    struct buf *b, *victim;
+    int nfree;
+
+    acquire(&bcache.lock);
+    victim = 0;
+    nfree = 0;
+    for(b = bcache.head.next; b != &bcache.head; b = b->next) {
+        if(b->dev == dev && b->blockno == blockno) {
+            release(&bcache.lock);
+            return 0;
+        }
+        if(b->refcnt == 0 && (b->flags & B_DIRTY) == 0) {
+            victim = b;
+            nfree++;
+        }
+    }
+    if(nfree <= MAXOPBLOCKS) {
+        release(&bcache.lock);
+        return -1;
+    }
+    victim->dev = dev;
+    victim->blockno = blockno;
+    victim->flags = B_ASYNC;
+    victim->refcnt = 1;
+    release(&bcache.lock);
+
+    acquiresleep(&victim->lock);  // unused, so this doesn't wait
+    ideasync(victim);
+    return 0;
+}
+
 // Release a locked buffer.
 // Move to the head of the MRU list.
 void brelse(struct buf *b) {
     if(!holdingsleep(&b->lock))
         panic("brelse");
+    bdone(b);
+}
 
+// Release b like brelse(), but without checking that the caller
+// holds it: the disk interrupt lets go of read-ahead buffers on
+// behalf of the process that started them.
+void bdone(struct buf *b) {
     releasesleep(&b->lock);
 
     acquire(&bcache.lock);
@@ -129,5 +174,28 @@ void brelse(struct buf *b) {
 
     release(&bcache.lock);
 }
+
+// Release a locked buffer holding file data. The page cache keeps
+// its own copy, so move it to the tail of the MRU list, to be
+// recycled before any metadata.
+void bdrop(struct buf *b) {
+    if(!holdingsleep(&b->lock))
+        panic("bdrop");
+
+    releasesleep(&b->lock);
+
+    acquire(&bcache.lock);
+    b->refcnt--;
+    if (b->refcnt == 0) {
+        b->next->prev = b->prev;
+        b->prev->next = b->next;
+        b->next = &bcache.head;
+        b->prev = bcache.head.prev;
+        bcache.head.prev->next = b;
+        bcache.head.prev = b;
+    }
+
+    release(&bcache.lock);
+}
 //PAGEBREAK!
 // Blank page.
@@ -11,6 +11,7 @@
 #include "memlayout.h"
 
 #define SECTSIZE  512
+#define MAXSECTS  256   // sectors per read command
 
 void readseg(uchar*, uint, uint);
 
@@ -51,38 +52,43 @@ void waitdisk(void) {
         ;
 }
 
-// Read a single sector at offset into dst.
-void readsect(void *dst, uint offset) {
+// Read n sectors (at most 256) starting at offset into dst,
+// with a single command.
+void readsects(uchar *dst, uint offset, uint n) {
     // Issue command.
     waitdisk();
-    outb(0x1F2, 1); // count = 1
+    outb(0x1F2, n); // count; 0 means 256
     outb(0x1F3, offset);
     outb(0x1F4, offset >> 8);
     outb(0x1F5, offset >> 16);
     outb(0x1F6, (offset >> 24) | 0xE0);
     outb(0x1F7, 0x20); // cmd 0x20 - read sectors
 
-    // Read data.
-    waitdisk();
-    insl(0x1F0, dst, SECTSIZE/4);
+    // Read data, a sector each time the disk is ready.
+    for(; n > 0; n--, dst += SECTSIZE) {
+        waitdisk();
+        insl(0x1F0, dst, SECTSIZE/4);
+    }
 }
 
 // Read 'count' bytes at 'offset' from kernel into physical address 'pa'.
 // Might copy more than asked.
 void readseg(uchar* pa, uint count, uint offset) {
-    uchar* epa;
-
-    epa = pa + count;
+    uint n, nsect;
 
     // Round down to sector boundary.
+    count += offset % SECTSIZE;
     pa -= offset % SECTSIZE;
+    nsect = (count + SECTSIZE - 1) / SECTSIZE;
 
     // Translate from bytes to sectors; kernel starts at sector 1.
     offset = (offset / SECTSIZE) + 1;
 
-    // If this is too slow, we could read lots of sectors at a time.
-    // We'd write more to memory than asked, but it doesn't matter --
-    // we load in increasing order.
-    for(; pa < epa; pa += SECTSIZE, offset++)
-        readsect(pa, offset);
+    // Read up to MAXSECTS sectors per command. We'd write more to
+    // memory than asked, but it doesn't matter -- we load in
+    // increasing order.
+    for(; nsect > 0; nsect -= n, pa += n*SECTSIZE, offset += n) {
+        n = nsect < MAXSECTS ? nsect : MAXSECTS;
+        readsects(pa, offset, n);
+    }
 }
@@ -2,6 +2,8 @@ struct buf;
 struct context;
 struct file;
 struct inode;
+struct iovec;
+struct kmem_cache;
 struct pipe;
 struct proc;
 struct rtcdate;
@@ -9,12 +11,19 @@ struct spinlock;
 struct sleeplock;
 struct stat;
 struct superblock;
+struct timer;
+struct hrtimer;
+struct vdata;
+struct vma;
 struct pstat;
 
 // bio.c
 void            binit(void);
 struct buf*     bread(uint, uint);
 void            brelse(struct buf*);
+void            bdrop(struct buf*);
+void            bdone(struct buf*);
+int             breadahead(uint, uint);
 void            bwrite(struct buf*);
 
 // console.c
@@ -32,8 +41,13 @@ void            fileclose(struct file*);
 struct file*    filedup(struct file*);
 void            fileinit(void);
 int             fileread(struct file*, char*, int n);
+int             filereadv(struct file*, struct iovec*, int);
+int             filepread(struct file*, char*, int, uint);
 int             filestat(struct file*, struct stat*);
 int             filewrite(struct file*, char*, int n);
+int             filewritev(struct file*, struct iovec*, int);
+int             filepwrite(struct file*, char*, int, uint);
+int             filesend(struct file*, struct file*, int);
 
 // fs.c
 void            readsb(int dev, struct superblock *sb);
@@ -41,14 +55,19 @@ int             dirlink(struct inode*, char*, uint);
 struct inode*   dirlookup(struct inode*, char*, uint*);
 struct inode*   ialloc(uint, short);
 struct inode*   idup(struct inode*);
+struct inode*   iget(uint, uint);
 void            iinit(int dev);
 void            ilock(struct inode*);
 void            iput(struct inode*);
 void            iunlock(struct inode*);
 void            iunlockput(struct inode*);
 void            iupdate(struct inode*);
+char*           ipage(struct inode*, uint);
+char*           itext(struct inode*, uint);
+void            ireadahead(struct inode*, uint, uint);
 int             namecmp(const char*, const char*);
 struct inode*   namei(char*);
+struct inode*   nameiat(struct inode*, char*);
 struct inode*   nameiparent(char*, char*);
 int             readi(struct inode*, char*, uint, uint);
 void            stati(struct inode*, struct stat*);
@@ -58,6 +77,7 @@ int             writei(struct inode*, char*, uint, uint);
 void            ideinit(void);
 void            ideintr(void);
 void            iderw(struct buf*);
+void            ideasync(struct buf*);
 
 // ioapic.c
 void            ioapicenable(int irq, int cpu);
@@ -69,9 +89,12 @@ char*           kalloc(void);
 void            kfree(char*);
 void            kinit1(void*, void*);
 void            kinit2(void*, void*);
+void            kinitslice(void);
+char*           hugealloc(void);
+extern uint     phystop;
 
 uint            getNumFreePages(void);
-void            decrementReferenceCount(uint pa);
+uint            decrementReferenceCount(uint pa);
 void            incrementReferenceCount(uint pa);
 uint            getReferenceCount(uint pa);
 
@@ -82,10 +105,14 @@ void            kbdintr(void);
 
 int             lapicid(void);
 void            cmostime(struct rtcdate *r);
+uint            cmosmemkb(void);
 extern volatile uint*    lapic;
+void            lapicarm(uint64);
 void            lapiceoi(void);
 void            lapicinit(void);
 void            lapicstartap(uchar, uint);
+int             lapictimer(void);
+void            lapicipi(uchar, int);
 void            microdelay(int);
 
 // log.c
@@ -98,6 +125,16 @@ void            end_op();
 extern int ismp;
 void            mpinit(void);
 
+// pcache.c
+void            pcacheinit(void);
+char*           pclookup(struct inode*, uint);
+int             pcinsert(struct inode*, uint, char*);
+void            pcdrop(struct inode*);
+char*           pctextlookup(struct inode*, uint);
+int             pctextinsert(struct inode*, uint, char*);
+void            pctextdrop(struct inode*);
+int             pcreclaim(int);
+
 // picirq.c
 void            picenable(int);
 void            picinit(void);
@@ -107,6 +144,7 @@ int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
 int             piperead(struct pipe*, char*, int);
 int             pipewrite(struct pipe*, char*, int);
+void            pipeinit(void);
 
 //PAGEBREAK: 16
 // proc.c
@@ -119,6 +157,7 @@ int             fork_original(void);
 
 int             growproc(int);
 int             kill(int);
+void            kthread(char*, void (*)(void));
 struct cpu*     mycpu(void);
 struct proc*    myproc();
 void            pinit(void);
@@ -127,6 +166,7 @@ void            scheduler(void) __attribute__((noreturn));
 void            sched(void);
 void            setproc(struct proc*);
 void            sleep(void*, struct spinlock*);
+char*           swapvictim(uint);
 void            userinit(void);
 int             wait(void);
 void            wakeup(void*);
@@ -136,6 +176,12 @@ int             testwait(int*, int*, int*);
 // swtch.S
 void            swtch(struct context**, struct context*);
 
+// slab.c
+void            slabinit(void);
+struct kmem_cache* kmem_cache_create(char*, uint, void (*)(void*));
+void*           kmem_cache_alloc(struct kmem_cache*);
+void            kmem_cache_free(struct kmem_cache*, void*);
+
 // spinlock.c
 void            acquire(struct spinlock*);
 void            getcallerpcs(void*, uint*);
@@ -151,6 +197,16 @@ void            releasesleep(struct sleeplock*);
 int             holdingsleep(struct sleeplock*);
 void            initsleeplock(struct sleeplock*, char*);
 
+// swap.c
+void            swapinit(int);
+int             swapalloc(void);
+void            swapdup(uint);
+void            swapfree(uint);
+void            swapread(uint, char*);
+int             swapwait(void);
+void            swapkick(void);
+void            kswapd(void);
+
 // string.c
 int             memcmp(const void*, const void*, uint);
 void*           memmove(void*, const void*, uint);
@@ -163,6 +219,7 @@ char*           strncpy(char*, const char*, int);
 // syscall.c
 int             argint(int, int*);
 int             argptr(int, char**, int);
+int             argout(int, char**, int);
 int             argstr(int, char**);
 int             fetchint(uint, int*);
 int             fetchstr(uint, char**);
@@ -170,6 +227,12 @@ void            syscall(void);
 
 // timer.c
 void            timerinit(void);
+void            timer_add(struct timer*, uint, void (*)(void*), void*);
+void            timer_del(struct timer*);
+void            timerexpire(void);
+void            hrtimer_add(struct hrtimer*, uint64, void (*)(void*), void*);
+void            hrtimer_del(struct hrtimer*);
+void            hrtimerexpire(void);
 
 // trap.c
 void            idtinit(void);
@@ -192,17 +255,34 @@ int             allocuvm(pde_t*, uint, uint);
 int             deallocuvm(pde_t*, uint, uint);
 void            freevm(pde_t*);
 void            inituvm(pde_t*, char*, uint);
-int             loaduvm(pde_t*, char*, struct inode*, uint, uint);
 
 pde_t*          copyuvm_original(pde_t*, uint);
 
-pde_t*          copyuvm(pde_t*, uint);
+pde_t*          copyuvm(struct proc*);
 void            switchuvm(struct proc*);
 void            switchkvm(void);
 int             copyout(pde_t*, uint, void*, uint);
 void            clearpteu(pde_t *pgdir, char *uva);
 
 void            pagefault(uint err_code);
+int             uvmprefault(uint, uint, int);
+int             uvmvalid(uint, uint);
+int             uvmunshare(struct proc*, uint, uint);
+uint            mmap(uint, int, int, struct file*, uint);
+int             munmap(uint, uint);
+int             copymmap(pde_t*, struct proc*);
+char*           clockscan(struct proc*, uint);
+void            tlbintr(void);
+void            tlbinval(pde_t*, uint);
+void            tlbflush(pde_t*);
+void            vmasync(struct proc*);
+void            vmadup(struct vma*, struct vma*);
+int             vmagrow(struct proc*, uint);
+void            vmashrink(struct proc*, uint);
+void            vmaclear(struct vma*);
+extern struct vdata*    vdata;
+void            vdsoinit(void);
+void            vdsotick(void);
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
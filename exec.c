@@ -9,14 +9,19 @@
 
 int exec(char *path, char **argv) {
     char *s, *last;
-    int i, off;
+    int i, off, nvma;
     uint argc, sz, sp, ustack[3+MAXARG+1];
+    struct vma vma[NVMA];
     struct elfhdr elf;
     struct inode *ip;
     struct proghdr ph;
     pde_t *pgdir, *oldpgdir;
     struct proc *curproc = myproc();
 
+    // Flush shared mappings of the old image while we can
+    // still start transactions.
+    vmasync(curproc);
+
     begin_op();
 
     if((ip = namei(path)) == 0) {
@@ -26,6 +31,7 @@ int exec(char *path, char **argv) {
     }
     ilock(ip);
     pgdir = 0;
+    memset(vma, 0, sizeof(vma));
 
     // Check ELF header
     if(readi(ip, (char*)&elf, 0, sizeof(elf)) != sizeof(elf))
@@ -36,8 +42,12 @@ int exec(char *path, char **argv) {
     if((pgdir = setupkvm()) == 0)
         goto bad;
 
-    // Load program into memory.
+    // Map the program's segments. Their pages are read in
+    // when first touched (see vmafill in vm.c). Each must start
+    // on the page where the last one ended, so that the vmas
+    // cover all of [0, sz) and no fault below sz goes unmapped.
     sz = 0;
+    nvma = 0;
     for(i=0, off=elf.phoff; i<elf.phnum; i++, off+=sizeof(ph)) {
         if(readi(ip, (char*)&ph, off, sizeof(ph)) != sizeof(ph))
             goto bad;
@@ -47,15 +57,21 @@ int exec(char *path, char **argv) {
             goto bad;
         if(ph.vaddr + ph.memsz < ph.vaddr)
             goto bad;
-        if((sz = allocuvm(pgdir, sz, ph.vaddr + ph.memsz)) == 0)
-            goto bad;
-        if(ph.vaddr % PGSIZE != 0)
+        if(ph.vaddr + ph.memsz >= MMAPBASE)
             goto bad;
-        if(loaduvm(pgdir, (char*)ph.vaddr, ip, ph.off, ph.filesz) < 0)
+        if(ph.memsz == 0)
+            continue;
+        if(ph.vaddr != sz || nvma >= NVMA)
             goto bad;
+        vma[nvma].start = ph.vaddr;
+        vma[nvma].end = PGROUNDUP(ph.vaddr + ph.memsz);
+        vma[nvma].ip = idup(ip);
+        vma[nvma].off = ph.off;
+        vma[nvma].filesz = ph.filesz;
+        sz = vma[nvma].end;
+        nvma++;
     }
     iunlockput(ip);
-    end_op();
     ip = 0;
 
     // Allocate two pages at the next page boundary.
@@ -92,9 +108,13 @@ int exec(char *path, char **argv) {
     safestrcpy(curproc->name, last, sizeof(curproc->name));
 
     // Commit to the user image.
+    vmaclear(curproc->vma);
+    memmove(curproc->vma, vma, sizeof(vma));
+    end_op();
     oldpgdir = curproc->pgdir;
     curproc->pgdir = pgdir;
     curproc->sz = sz;
+    curproc->ring = 0;
     curproc->tf->eip = elf.entry; // main
     curproc->tf->esp = sp;
     switchuvm(curproc);
@@ -104,9 +124,9 @@ int exec(char *path, char **argv) {
 bad:
     if(pgdir)
         freevm(pgdir);
-    if(ip) {
+    if(ip)
         iunlockput(ip);
-        end_op();
-    }
+    vmaclear(vma);
+    end_op();
     return -1;
 }
@@ -0,0 +1,37 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+// Exec latency benchmark. Re-executes itself N times; the
+// child exits straight away, so the time measured is that of
+// fork + exec + exit + wait. The padding array makes this a
+// usertests-sized binary, most of which is never touched.
+
+#define N 200
+
+char padding[40*1024] = { 1 };
+
+int main(int argc, char *argv[]) {
+    char *args[] = { "execbench", "child", 0 };
+    int i, pid, t0;
+
+    if(argc > 1)
+        exit();
+
+    t0 = uptime();
+    for(i = 0; i < N; i++) {
+        pid = fork();
+        if(pid < 0) {
+            printf(1, "execbench: fork failed\n");
+            exit();
+        }
+        if(pid == 0) {
+            exec("execbench", args);
+            printf(1, "execbench: exec failed\n");
+            exit();
+        }
+        wait();
+    }
+    printf(1, "%d execs: %d ticks\n", N, uptime() - t0);
+    exit();
+}
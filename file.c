@@ -5,35 +5,37 @@
 #include "types.h"
 #include "defs.h"
 #include "param.h"
+#include "stat.h"
+#include "mmu.h"
 #include "fs.h"
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "uio.h"
 
 struct devsw devsw[NDEV];
+
+// File structures come from a slab cache; ftable.lock
+// protects their reference counts.
 struct {
     struct spinlock lock;
-    struct file file[NFILE];
+    struct kmem_cache *cache;
 } ftable;
 
 void fileinit(void) {
     initlock(&ftable.lock, "ftable");
+    ftable.cache = kmem_cache_create("file", sizeof(struct file), 0);
 }
 
 // Allocate a file structure.
 struct file* filealloc(void) {
     struct file *f;
 
-    acquire(&ftable.lock);
-    for(f = ftable.file; f < ftable.file + NFILE; f++) {
-        if(f->ref == 0) {
-            f->ref = 1;
-            release(&ftable.lock);
-            return f;
-        }
-    }
-    release(&ftable.lock);
-    return 0;
+    if((f = kmem_cache_alloc(ftable.cache)) == 0)
+        return 0;
+    memset(f, 0, sizeof(*f));
+    f->ref = 1;
+    return f;
 }
 
 // Increment ref count for file f.
@@ -61,6 +63,7 @@ void fileclose(struct file *f) {
     f->ref = 0;
     f->type = FD_NONE;
     release(&ftable.lock);
+    kmem_cache_free(ftable.cache, f);
 
     if(ff.type == FD_PIPE)
         pipeclose(ff.pipe, ff.writable);
@@ -82,61 +85,212 @@ int filestat(struct file *f, struct stat *st) {
     return -1;
 }
 
+// Read from inode file f at *off into the cnt buffers of iov,
+// in order, stopping at the end of the file. Advances *off.
+static int ireadv(struct file *f, struct iovec *iov, int cnt, uint *off) {
+    int i, r, tot;
+
+    tot = 0;
+    ilock(f->ip);
+    for(i = 0; i < cnt; i++) {
+        if((r = readi(f->ip, iov[i].iov_base, *off, iov[i].iov_len)) < 0) {
+            if(tot == 0)
+                tot = -1;
+            break;
+        }
+        *off += r;
+        tot += r;
+        if(r < iov[i].iov_len)
+            break;
+    }
+    iunlock(f->ip);
+    return tot;
+}
+
+// Write the cnt buffers of iov to inode file f at *off, in order.
+// Advances *off.
+static int iwritev(struct file *f, struct iovec *iov, int cnt, uint *off) {
+    // write a few blocks at a time to avoid exceeding
+    // the maximum log transaction size, including
+    // i-node, indirect block, allocation blocks,
+    // and 2 blocks of slop for non-aligned writes.
+    // this really belongs lower down, since writei()
+    // might be writing a device like the console.
+    // The buffers land one after another in the file, so
+    // one transaction can take pieces of several of them.
+    int max = ((MAXOPBLOCKS-1-1-2) / 2) * 512;
+    int i, n1, r, tot, used;
+    uint done;
+
+    i = 0;
+    done = 0;
+    tot = 0;
+    r = 0;
+    while(i < cnt) {
+        begin_op();
+        ilock(f->ip);
+        for(used = 0; i < cnt && used < max; ) {
+            n1 = iov[i].iov_len - done;
+            if(n1 > max - used)
+                n1 = max - used;
+            if((r = writei(f->ip, (char*)iov[i].iov_base + done, *off, n1)) < 0)
+                break;
+            if(r != n1)
+                panic("short filewrite");
+            *off += r;
+            used += r;
+            if((done += r) == iov[i].iov_len) {
+                i++;
+                done = 0;
+            }
+        }
+        iunlock(f->ip);
+        end_op();
+
+        if(r < 0)
+            return -1;
+        tot += used;
+    }
+    return tot;
+}
+
 // Read from file f.
 int fileread(struct file *f, char *addr, int n) {
-    int r;
+    struct iovec iov;
+
+    iov.iov_base = addr;
+    iov.iov_len = n;
+    return filereadv(f, &iov, 1);
+}
+
+// Read from file f into the cnt buffers of iov, filling each
+// before moving on to the next. A pipe read returns whatever is
+// in the pipe without waiting for more, so only the first
+// non-empty buffer is read into from a pipe.
+int filereadv(struct file *f, struct iovec *iov, int cnt) {
+    int i;
 
     if(f->readable == 0)
         return -1;
-    if(f->type == FD_PIPE)
-        return piperead(f->pipe, addr, n);
-    if(f->type == FD_INODE) {
-        ilock(f->ip);
-        if((r = readi(f->ip, addr, f->off, n)) > 0)
-            f->off += r;
-        iunlock(f->ip);
-        return r;
+    if(f->type == FD_PIPE) {
+        for(i = 0; i < cnt; i++)
+            if(iov[i].iov_len > 0)
+                return piperead(f->pipe, iov[i].iov_base, iov[i].iov_len);
+        return 0;
     }
+    if(f->type == FD_INODE)
+        return ireadv(f, iov, cnt, &f->off);
     panic("fileread");
 }
 
+// Read from file f at offset off, leaving f->off alone.
+int filepread(struct file *f, char *addr, int n, uint off) {
+    struct iovec iov;
+
+    if(f->readable == 0 || f->type != FD_INODE)
+        return -1;
+    iov.iov_base = addr;
+    iov.iov_len = n;
+    return ireadv(f, &iov, 1, &off);
+}
+
 //PAGEBREAK!
 // Write to file f.
 int filewrite(struct file *f, char *addr, int n) {
-    int r;
+    struct iovec iov;
+
+    iov.iov_base = addr;
+    iov.iov_len = n;
+    return filewritev(f, &iov, 1);
+}
+
+// Write the cnt buffers of iov to file f, in order.
+int filewritev(struct file *f, struct iovec *iov, int cnt) {
+    int i, r, tot;
 
     if(f->writable == 0)
         return -1;
-    if(f->type == FD_PIPE)
-        return pipewrite(f->pipe, addr, n);
-    if(f->type == FD_INODE) {
-        // write a few blocks at a time to avoid exceeding
-        // the maximum log transaction size, including
-        // i-node, indirect block, allocation blocks,
-        // and 2 blocks of slop for non-aligned writes.
-        // this really belongs lower down, since writei()
-        // might be writing a device like the console.
-        int max = ((MAXOPBLOCKS-1-1-2) / 2) * 512;
-        int i = 0;
-        while(i < n) {
-            int n1 = n - i;
-            if(n1 > max)
-                n1 = max;
-
-            begin_op();
-            ilock(f->ip);
-            if ((r = writei(f->ip, addr + i, f->off, n1)) > 0)
-                f->off += r;
-            iunlock(f->ip);
-            end_op();
+    if(f->type == FD_PIPE) {
+        tot = 0;
+        for(i = 0; i < cnt; i++) {
+            if((r = pipewrite(f->pipe, iov[i].iov_base, iov[i].iov_len)) < 0)
+                return -1;
+            tot += r;
+        }
+        return tot;
+    }
+    if(f->type == FD_INODE)
+        return iwritev(f, iov, cnt, &f->off);
+    panic("filewrite");
+}
+
+// Write to file f at offset off, leaving f->off alone.
+int filepwrite(struct file *f, char *addr, int n, uint off) {
+    struct iovec iov;
 
+    if(f->writable == 0 || f->type != FD_INODE)
+        return -1;
+    iov.iov_base = addr;
+    iov.iov_len = n;
+    return iwritev(f, &iov, 1, &off);
+}
+
+//PAGEBREAK!
+// Copy up to n bytes from file in, at its offset, to file out,
+// without the data passing through user space. File data goes
+// to out straight from the page cache; pipes and devices are
+// read into a bounce page, once, so that a call never waits for
+// more than they have. Returns the number of bytes copied, 0 at
+// the end of in, or -1.
+int filesend(struct file *out, struct file *in, int n) {
+    char *page, *bounce;
+    int m, r, tot;
+    uint off;
+
+    if(in->readable == 0 || out->writable == 0 || n < 0)
+        return -1;
+
+    bounce = 0;
+    r = 0;
+    for(tot = 0; tot < n; tot += m) {
+        if(in->type == FD_INODE && in->ip->type != T_DEV) {
+            ilock(in->ip);
+            off = in->off;
+            if(off >= in->ip->size) {
+                iunlock(in->ip);
+                break;
+            }
+            m = n - tot;
+            if(m > PGSIZE - off%PGSIZE)
+                m = PGSIZE - off%PGSIZE;
+            if(m > in->ip->size - off)
+                m = in->ip->size - off;
+            page = ipage(in->ip, off / PGSIZE);
+            iunlock(in->ip);
+            if(page == 0) {
+                r = -1;
+                break;
+            }
+            r = filewrite(out, page + off%PGSIZE, m);
+            kfree(page);
             if(r < 0)
                 break;
-            if(r != n1)
-                panic("short filewrite");
-            i += r;
+            in->off = off + m;
+            continue;
         }
-        return i == n ? n : -1;
+
+        if((bounce = kalloc()) == 0) {
+            r = -1;
+            break;
+        }
+        m = n - tot < PGSIZE ? n - tot : PGSIZE;
+        if((r = fileread(in, bounce, m)) > 0 && (r = filewrite(out, bounce, r)) > 0)
+            tot += r;
+        break;
     }
-    panic("filewrite");
+    if(bounce)
+        kfree(bounce);
+    if(tot == 0 && r < 0)
+        return -1;
+    return tot;
 }
@@ -23,6 +23,16 @@ struct inode {
     short nlink;
     uint size;
     uint addrs[NDIRECT+1];
+
+    // protected by icache.lock
+    struct inode *hnext;    // hash chain
+    struct inode *lrunext;  // idle list, while ref == 0
+    struct inode *lruprev;
+
+    // protected by pcache.lock
+    struct pcnode *pages;   // cached file pages; see pcache.c
+    struct pcnode *text;    // cached unaligned copies, for exec
+    uint textoff;           // where in each page they start
 };
 
 // table mapping major device number to
@@ -14,6 +14,7 @@
 #include "param.h"
 #include "stat.h"
 #include "mmu.h"
+#include "memlayout.h"
 #include "proc.h"
 #include "spinlock.h"
 #include "sleeplock.h"
@@ -113,7 +114,7 @@ static void bfree(int dev, uint b) {
 //   the reference and link counts have fallen to zero.
 //
 // * Referencing in cache: an entry in the inode cache
-//   is free if ip->ref is zero. Otherwise ip->ref tracks
+//   is idle if ip->ref is zero. Otherwise ip->ref tracks
 //   the number of in-memory pointers to the entry (open
 //   files and current directories). iget() finds or
 //   creates a cache entry and increments its ref; iput()
@@ -123,7 +124,9 @@ static void bfree(int dev, uint b) {
 //   cache entry is only correct when ip->valid is 1.
 //   ilock() reads the inode from
 //   the disk and sets ip->valid, while iput() clears
-//   ip->valid if ip->ref has fallen to zero.
+//   ip->valid when it frees the inode on disk. An idle
+//   entry that is still valid can be reused without
+//   reading the disk.
 //
 // * Locked: file system code may only examine and modify
 //   the information in an inode and its content if it
@@ -147,27 +150,43 @@ static void bfree(int dev, uint b) {
 // have locked the inodes involved; this lets callers create
 // multi-step atomic operations.
 //
-// The icache.lock spin-lock protects the allocation of icache
-// entries. Since ip->ref indicates whether an entry is free,
-// and ip->dev and ip->inum indicate which i-node an entry
+// In-memory inodes are allocated from a slab cache and found
+// through a hash table keyed on (dev, inum). When ip->ref falls
+// to zero the inode stays in the hash on an LRU list of idle
+// entries, so that reopening a recently used file does not have
+// to read it from disk again; once more than NINODE inodes are
+// idle, the least recently used one is freed.
+//
+// The icache.lock spin-lock protects the hash chains, the idle
+// list and ip->ref. Since ip->ref indicates whether an entry is
+// idle, and ip->dev and ip->inum indicate which i-node an entry
 // holds, one must hold icache.lock while using any of those fields.
 //
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
 // dev, and inum.  One must hold ip->lock in order to
 // read or write that inode's ip->valid, ip->size, ip->type, &c.
 
+#define NIHASH 64
+#define IHASH(dev, inum) (((dev) * 31 + (inum)) % NIHASH)
+
 struct {
     struct spinlock lock;
-    struct inode inode[NINODE];
+    struct kmem_cache *cache;
+    struct inode *hash[NIHASH];
+    struct inode idle;      // idle list; idle.lrunext is the oldest
+    int nidle;
 } icache;
 
-void iinit(int dev) {
-    int i = 0;
+// Slab constructor: an inode's sleep-lock survives being
+// freed and reallocated.
+static void inodector(void *v) {
+    initsleeplock(&((struct inode*)v)->lock, "inode");
+}
 
+void iinit(int dev) {
     initlock(&icache.lock, "icache");
-    for(i = 0; i < NINODE; i++) {
-        initsleeplock(&icache.inode[i].lock, "inode");
-    }
+    icache.cache = kmem_cache_create("inode", sizeof(struct inode), inodector);
+    icache.idle.lrunext = icache.idle.lruprev = &icache.idle;
 
     readsb(dev, &sb);
     cprintf("sb: size %d nblocks %d ninodes %d nlog %d logstart %d\
@@ -176,8 +195,6 @@ void iinit(int dev) {
             sb.bmapstart);
 }
 
-static struct inode* iget(uint dev, uint inum);
-
 //PAGEBREAK!
 // Allocate an inode on device dev.
 // Mark it as allocated by  giving it type type.
@@ -222,35 +239,64 @@ void iupdate(struct inode *ip) {
     brelse(bp);
 }
 
+// Remove ip from the hash table. Caller holds icache.lock.
+static void iunhash(struct inode *ip) {
+    struct inode **pp;
+
+    for(pp = &icache.hash[IHASH(ip->dev, ip->inum)]; *pp != ip; pp = &(*pp)->hnext)
+        ;
+    *pp = ip->hnext;
+}
+
+static void idle_remove(struct inode *ip) {
+    ip->lruprev->lrunext = ip->lrunext;
+    ip->lrunext->lruprev = ip->lruprev;
+    icache.nidle--;
+}
+
 // Find the inode with number inum on device dev
 // and return the in-memory copy. Does not lock
 // the inode and does not read it from disk.
-static struct inode* iget(uint dev, uint inum) {
-    struct inode *ip, *empty;
+struct inode* iget(uint dev, uint inum) {
+    struct inode *ip, *ip1;
 
     acquire(&icache.lock);
 
     // Is the inode already cached?
-    empty = 0;
-    for(ip = &icache.inode[0]; ip < &icache.inode[NINODE]; ip++) {
-        if(ip->ref > 0 && ip->dev == dev && ip->inum == inum) {
-            ip->ref++;
+    for(ip = icache.hash[IHASH(dev, inum)]; ip; ip = ip->hnext) {
+        if(ip->dev == dev && ip->inum == inum) {
+            if(ip->ref++ == 0)
+                idle_remove(ip);
             release(&icache.lock);
             return ip;
         }
-        if(empty == 0 && ip->ref == 0) // Remember empty slot.
-            empty = ip;
     }
+    release(&icache.lock);
 
-    // Recycle an inode cache entry.
-    if(empty == 0)
+    // Allocate a fresh entry.
+    if((ip = kmem_cache_alloc(icache.cache)) == 0)
         panic("iget: no inodes");
-
-    ip = empty;
     ip->dev = dev;
     ip->inum = inum;
     ip->ref = 1;
     ip->valid = 0;
+    ip->pages = 0;
+    ip->text = 0;
+
+    // Someone may have cached the same inode while we were
+    // allocating; if so, use theirs.
+    acquire(&icache.lock);
+    for(ip1 = icache.hash[IHASH(dev, inum)]; ip1; ip1 = ip1->hnext) {
+        if(ip1->dev == dev && ip1->inum == inum) {
+            if(ip1->ref++ == 0)
+                idle_remove(ip1);
+            release(&icache.lock);
+            kmem_cache_free(icache.cache, ip);
+            return ip1;
+        }
+    }
+    ip->hnext = icache.hash[IHASH(dev, inum)];
+    icache.hash[IHASH(dev, inum)] = ip;
     release(&icache.lock);
 
     return ip;
@@ -324,8 +370,36 @@ void iput(struct inode *ip) {
     releasesleep(&ip->lock);
 
     acquire(&icache.lock);
-    ip->ref--;
+    if(--ip->ref > 0) {
+        release(&icache.lock);
+        return;
+    }
+    if(!ip->valid) {
+        // Freed on disk (or never read): nothing worth caching.
+        iunhash(ip);
+        release(&icache.lock);
+        pcdrop(ip);
+        kmem_cache_free(icache.cache, ip);
+        return;
+    }
+
+    // Park it on the idle list, evicting the oldest idle inode
+    // if there are too many.
+    ip->lruprev = icache.idle.lruprev;
+    ip->lrunext = &icache.idle;
+    icache.idle.lruprev->lrunext = ip;
+    icache.idle.lruprev = ip;
+    ip = 0;
+    if(++icache.nidle > NINODE) {
+        ip = icache.idle.lrunext;
+        idle_remove(ip);
+        iunhash(ip);
+    }
     release(&icache.lock);
+    if(ip) {
+        pcdrop(ip);
+        kmem_cache_free(icache.cache, ip);
+    }
 }
 
 // Common idiom: unlock, then put.
@@ -382,6 +456,8 @@ static void itrunc(struct inode *ip) {
     struct buf *bp;
     uint *a;
 
+    pcdrop(ip);
+
     for(i = 0; i < NDIRECT; i++) {
         if(ip->addrs[i]) {
             bfree(ip->dev, ip->addrs[i]);
@@ -416,11 +492,92 @@ void stati(struct inode *ip, struct stat *st) {
 }
 
 //PAGEBREAK!
+// Return page pgno of ip's data, from the page cache or read in
+// from disk, with a reference taken for the caller (kfree() it
+// when done). Bytes past the end of the file read as zeroes.
+// Caller must hold ip->lock.
+char* ipage(struct inode *ip, uint pgno) {
+    struct buf *bp;
+    char *mem;
+    uint off, i;
+
+    if((mem = pclookup(ip, pgno)) != 0)
+        return mem;
+
+    if((mem = kalloc()) == 0)
+        return 0;
+    memset(mem, 0, PGSIZE);
+    off = pgno * PGSIZE;
+    // Queue all of the page's blocks on the disk before waiting
+    // for any of them.
+    for(i = 0; i < PGSIZE && off + i < ip->size; i += BSIZE)
+        if(breadahead(ip->dev, bmap(ip, (off + i) / BSIZE)) < 0)
+            break;
+    for(i = 0; i < PGSIZE && off + i < ip->size; i += BSIZE) {
+        bp = bread(ip->dev, bmap(ip, (off + i) / BSIZE));
+        memmove(mem + i, bp->data, min(BSIZE, ip->size - (off + i)));
+        bdrop(bp);
+    }
+    pcinsert(ip, pgno, mem);
+    return mem;
+}
+
+// Return a page of ip's data starting at off, which need not be
+// page-aligned, for exec to map. Unaligned pages are copied out
+// of the page cache once and kept as well (see pctextinsert).
+// Same rules as ipage().
+char* itext(struct inode *ip, uint off) {
+    char *mem, *page;
+    uint i, m;
+
+    if(off % PGSIZE == 0)
+        return ipage(ip, off / PGSIZE);
+    if((mem = pctextlookup(ip, off)) != 0)
+        return mem;
+
+    if((mem = kalloc()) == 0)
+        return 0;
+    for(i = 0; i < PGSIZE; i += m) {
+        if((page = ipage(ip, (off + i) / PGSIZE)) == 0) {
+            kfree(mem);
+            return 0;
+        }
+        m = min(PGSIZE - i, PGSIZE - (off + i) % PGSIZE);
+        memmove(mem + i, page + (off + i) % PGSIZE, m);
+        kfree(page);
+    }
+    pctextinsert(ip, off, mem);
+    return mem;
+}
+
+// Start reading the pages of ip that hold [off, off+n) and are
+// not in the page cache, without waiting for the disk (see
+// breadahead), so that a later readi() finds them on their way.
+// Stops early when the buffer cache has nothing to spare.
+// Caller must hold ip->lock.
+void ireadahead(struct inode *ip, uint off, uint n) {
+    uint pgno, a, end;
+    char *page;
+
+    if(ip->type == T_DEV || off >= ip->size)
+        return;
+    end = ip->size - off < n ? ip->size : off + n;
+    for(pgno = off / PGSIZE; pgno * PGSIZE < end; pgno++) {
+        if((page = pclookup(ip, pgno)) != 0) {
+            kfree(page);
+            continue;
+        }
+        for(a = pgno * PGSIZE; a < (pgno + 1) * PGSIZE && a < ip->size; a += BSIZE)
+            if(breadahead(ip->dev, bmap(ip, a / BSIZE)) < 0)
+                return;
+    }
+}
+
 // Read data from inode.
 // Caller must hold ip->lock.
 int readi(struct inode *ip, char *dst, uint off, uint n) {
     uint tot, m;
-    struct buf *bp;
+    char *page;
 
     if(ip->type == T_DEV) {
         if(ip->major < 0 || ip->major >= NDEV || !devsw[ip->major].read)
@@ -434,20 +591,24 @@ int readi(struct inode *ip, char *dst, uint off, uint n) {
         n = ip->size - off;
 
     for(tot=0; tot<n; tot+=m, off+=m, dst+=m) {
-        bp = bread(ip->dev, bmap(ip, off/BSIZE));
-        m = min(n - tot, BSIZE - off%BSIZE);
-        memmove(dst, bp->data + off%BSIZE, m);
-        brelse(bp);
+        if((page = ipage(ip, off/PGSIZE)) == 0)
+            return -1;
+        m = min(n - tot, PGSIZE - off%PGSIZE);
+        memmove(dst, page + off%PGSIZE, m);
+        kfree(page);
     }
     return n;
 }
 
 // PAGEBREAK!
 // Write data to inode.
+// Data blocks go through the log as before; pages of the file
+// that are in the page cache are brought up to date as well.
 // Caller must hold ip->lock.
 int writei(struct inode *ip, char *src, uint off, uint n) {
     uint tot, m;
     struct buf *bp;
+    char *page;
 
     if(ip->type == T_DEV) {
         if(ip->major < 0 || ip->major >= NDEV || !devsw[ip->major].write)
@@ -460,12 +621,20 @@ int writei(struct inode *ip, char *src, uint off, uint n) {
     if(off + n > MAXFILE*BSIZE)
         return -1;
 
+    // Running programs keep the pages they already have.
+    if(n > 0 && ip->text)
+        pctextdrop(ip);
+
     for(tot=0; tot<n; tot+=m, off+=m, src+=m) {
         bp = bread(ip->dev, bmap(ip, off/BSIZE));
         m = min(n - tot, BSIZE - off%BSIZE);
         memmove(bp->data + off%BSIZE, src, m);
         log_write(bp);
-        brelse(bp);
+        bdrop(bp);
+        if((page = pclookup(ip, off/PGSIZE)) != 0) {
+            memmove(page + off%PGSIZE, src, m);
+            kfree(page);
+        }
     }
 
     if(n > 0 && off > ip->size) {
@@ -577,14 +746,16 @@ static char* skipelem(char *path, char *name) {
 // Look up and return the inode for a path name.
 // If parent != 0, return the inode for the parent and copy the final
 // path element into name, which must have room for DIRSIZ bytes.
+// A relative path starts at dp, or at the current directory if
+// dp is 0.
 // Must be called inside a transaction since it calls iput().
-static struct inode* namex(char *path, int nameiparent, char *name) {
+static struct inode* namex(struct inode *dp, char *path, int nameiparent, char *name) {
     struct inode *ip, *next;
 
     if(*path == '/')
         ip = iget(ROOTDEV, ROOTINO);
     else
-        ip = idup(myproc()->cwd);
+        ip = idup(dp ? dp : myproc()->cwd);
 
     while((path = skipelem(path, name)) != 0) {
         ilock(ip);
@@ -613,9 +784,15 @@ static struct inode* namex(char *path, int nameiparent, char *name) {
 
 struct inode* namei(char *path) {
     char name[DIRSIZ];
-    return namex(path, 0, name);
+    return namex(0, path, 0, name);
 }
 
 struct inode* nameiparent(char *path, char *name) {
-    return namex(path, 1, name);
+    return namex(0, path, 1, name);
+}
+
+// Like namei(), but a relative path starts at directory dp.
+struct inode* nameiat(struct inode *dp, char *path) {
+    char name[DIRSIZ];
+    return namex(dp, path, 0, name);
 }
@@ -7,7 +7,7 @@
 
 // Disk layout:
 // [ boot block | super block | log | inode blocks |
-//                                          free bit map | data blocks]
+//                             free bit map | data blocks | swap area ]
 //
 // mkfs computes the super block and builds an initial file system. The
 // super block describes the disk layout:
@@ -19,8 +19,12 @@ struct superblock {
     uint logstart;   // Block number of first log block
     uint inodestart; // Block number of first inode block
     uint bmapstart;  // Block number of first free map block
+    uint swapstart;  // Block number of first swap block
+    uint nswap;      // Number of swap pages
 };
 
+#define SWAPBPP (4096 / BSIZE)  // blocks per swap page
+
 #define NDIRECT 12
 #define NINDIRECT (BSIZE / sizeof(uint))
 #define MAXFILE (NDIRECT + NINDIRECT)
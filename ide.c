@@ -69,7 +69,7 @@ void ideinit(void) {
 static void idestart(struct buf *b) {
     if(b == 0)
         panic("idestart");
-    if(b->blockno >= FSSIZE)
+    if(b->blockno >= FSSIZE + NSWAP*SWAPBPP)
         panic("incorrect blockno");
     int sector_per_block =  BSIZE/SECTOR_SIZE;
     int sector = b->blockno * sector_per_block;
@@ -110,10 +110,15 @@ void ideintr(void) {
     if(!(b->flags & B_DIRTY) && idewait(1) >= 0)
         insl(0x1f0, b->data, BSIZE/4);
 
-    // Wake process waiting for this buf.
+    // Wake process waiting for this buf, or finish a read-ahead
+    // that nobody is waiting for.
     b->flags |= B_VALID;
     b->flags &= ~B_DIRTY;
-    wakeup(b);
+    if(b->flags & B_ASYNC) {
+        b->flags &= ~B_ASYNC;
+        bdone(b);
+    } else
+        wakeup(b);
 
     // Start disk on next buf in queue.
     if(idequeue != 0)
@@ -123,10 +128,9 @@ void ideintr(void) {
 }
 
 //PAGEBREAK!
-// Sync buf with disk.
-// If B_DIRTY is set, write buf to disk, clear B_DIRTY, set B_VALID.
-// Else if B_VALID is not set, read buf from disk, set B_VALID.
-void iderw(struct buf *b) {
+// Append b to idequeue, starting the disk if it is idle.
+// Caller holds idelock.
+static void ideappend(struct buf *b) {
     struct buf **pp;
 
     if(!holdingsleep(&b->lock))
@@ -136,8 +140,6 @@ void iderw(struct buf *b) {
     if(b->dev != 0 && !havedisk1)
         panic("iderw: ide disk 1 not present");
 
-    acquire(&idelock); //DOC:acquire-lock
-
     // Append b to idequeue.
     b->qnext = 0;
     for(pp=&idequeue; *pp; pp=&(*pp)->qnext) //DOC:insert-queue
@@ -147,6 +149,25 @@ void iderw(struct buf *b) {
     // Start disk if necessary.
     if(idequeue == b)
         idestart(b);
+}
+
+// Start reading b, which has B_ASYNC set, and return without
+// waiting. The caller's lock on b passes to the disk, and
+// ideintr() lets go of it (bdone) once the data is in.
+void ideasync(struct buf *b) {
+    if(!(b->flags & B_ASYNC) || (b->flags & B_DIRTY))
+        panic("ideasync");
+    acquire(&idelock);
+    ideappend(b);
+    release(&idelock);
+}
+
+// Sync buf with disk.
+// If B_DIRTY is set, write buf to disk, clear B_DIRTY, set B_VALID.
+// Else if B_VALID is not set, read buf from disk, set B_VALID.
+void iderw(struct buf *b) {
+    acquire(&idelock); //DOC:acquire-lock
+    ideappend(b);
 
     // Wait for request to finish.
     while((b->flags & (B_VALID|B_DIRTY)) != B_VALID) {
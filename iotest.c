@@ -0,0 +1,225 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "uio.h"
+
+// Tests for pread(), pwrite(), readv(), writev(), sendfile(),
+// getdents() and fstatat().
+
+char buf[4096];
+
+void fail(char *msg) {
+    printf(1, "iotest: %s\n", msg);
+    exit();
+}
+
+// pread and pwrite use their own offsets and leave the file's
+// alone.
+void ptest(void) {
+    int fd, i;
+
+    printf(1, "pread/pwrite\n");
+    unlink("iofile");
+    if((fd = open("iofile", O_CREATE|O_RDWR)) < 0)
+        fail("cannot create iofile");
+    memset(buf, 'a', sizeof(buf));
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf))
+        fail("write failed");
+    if(pwrite(fd, "xyz", 3, 1000) != 3)
+        fail("pwrite failed");
+    if(pread(fd, buf, 5, 999) != 5 || buf[0] != 'a' || buf[1] != 'x' ||
+       buf[3] != 'z' || buf[4] != 'a')
+        fail("pread read the wrong data");
+    if(pread(fd, buf, 100, sizeof(buf) - 10) != 10)
+        fail("pread past the end of the file");
+    if(read(fd, buf, 1) != 0)
+        fail("pread/pwrite moved the file offset");
+
+    // Concurrent readers of one descriptor.
+    if(fork() == 0) {
+        for(i = 0; i < 100; i++)
+            if(pread(fd, buf, 3, 1000) != 3 || buf[0] != 'x')
+                fail("pread in child");
+        exit();
+    }
+    for(i = 0; i < 100; i++)
+        if(pread(fd, buf, 3, 1000) != 3 || buf[2] != 'z')
+            fail("pread in parent");
+    wait();
+    close(fd);
+    unlink("iofile");
+}
+
+// readv and writev go through their buffers in order.
+void vtest(void) {
+    struct iovec iov[3];
+    char a[100], b[1000], c[2000];
+    int fd, i;
+
+    printf(1, "readv/writev\n");
+    memset(a, 'a', sizeof(a));
+    memset(b, 'b', sizeof(b));
+    memset(c, 'c', sizeof(c));
+    iov[0].iov_base = a;
+    iov[0].iov_len = sizeof(a);
+    iov[1].iov_base = b;
+    iov[1].iov_len = sizeof(b);
+    iov[2].iov_base = c;
+    iov[2].iov_len = sizeof(c);
+
+    unlink("iofile");
+    if((fd = open("iofile", O_CREATE|O_RDWR)) < 0)
+        fail("cannot create iofile");
+    if(writev(fd, iov, 3) != sizeof(a) + sizeof(b) + sizeof(c))
+        fail("writev failed");
+    close(fd);
+
+    memset(a, 0, sizeof(a));
+    memset(b, 0, sizeof(b));
+    memset(c, 0, sizeof(c));
+    iov[1].iov_len = 0;
+    fd = open("iofile", O_RDONLY);
+    if(readv(fd, iov, 3) != sizeof(a) + sizeof(c))
+        fail("readv failed");
+    for(i = 0; i < sizeof(a); i++)
+        if(a[i] != 'a')
+            fail("readv: wrong data in first buffer");
+    if(b[0] != 0)
+        fail("readv: wrote to an empty buffer");
+    for(i = 0; i < sizeof(c); i++)
+        if(c[i] != (i < sizeof(b) ? 'b' : 'c'))
+            fail("readv: wrong data in last buffer");
+    // What is left is as long as the skipped buffer.
+    if(readv(fd, iov, 3) != sizeof(b))
+        fail("readv at the end of the file");
+    close(fd);
+    unlink("iofile");
+
+    iov[0].iov_base = (char*)0xffff0000;
+    if(writev(1, iov, 1) >= 0)
+        fail("writev of a kernel address");
+}
+
+// sendfile copies from a file to a file and to a pipe, and
+// from a pipe, and moves the source offset along.
+void sendtest(void) {
+    int in, out, p[2], i, n;
+
+    printf(1, "sendfile\n");
+    unlink("iofile");
+    unlink("iofile2");
+    if((in = open("iofile", O_CREATE|O_RDWR)) < 0)
+        fail("cannot create iofile");
+    for(i = 0; i < sizeof(buf); i++)
+        buf[i] = i % 251;
+    for(i = 0; i < 3; i++)
+        if(write(in, buf, sizeof(buf)) != sizeof(buf))
+            fail("write failed");
+    close(in);
+
+    in = open("iofile", O_RDONLY);
+    out = open("iofile2", O_CREATE|O_RDWR);
+    if(sendfile(out, in, 100) != 100)
+        fail("short sendfile");
+    while((n = sendfile(out, in, 5000)) > 0)
+        ;
+    if(n < 0)
+        fail("sendfile failed");
+    close(out);
+    out = open("iofile2", O_RDONLY);
+    for(n = 0; (i = read(out, buf, sizeof(buf))) > 0; n += i)
+        if(i != sizeof(buf) || buf[0] != 0 || buf[100] != 100)
+            fail("sendfile copied the wrong data");
+    if(n != 3*sizeof(buf))
+        fail("sendfile copied the wrong amount");
+    close(out);
+
+    // File to pipe, and pipe to file.
+    if(pipe(p) < 0)
+        fail("pipe failed");
+    if(fork() == 0) {
+        close(p[0]);
+        in = open("iofile", O_RDONLY);
+        while(sendfile(p[1], in, sizeof(buf)) > 0)
+            ;
+        exit();
+    }
+    close(p[1]);
+    unlink("iofile2");
+    out = open("iofile2", O_CREATE|O_RDWR);
+    for(n = 0; (i = sendfile(out, p[0], sizeof(buf))) > 0; n += i)
+        ;
+    wait();
+    close(p[0]);
+    close(out);
+    if(n != 3*sizeof(buf))
+        fail("sendfile through a pipe copied the wrong amount");
+    unlink("iofile");
+    unlink("iofile2");
+}
+
+// getdents returns every entry of a directory once, stat'd if
+// asked, and fstatat looks names up relative to a directory.
+void dirtest(void) {
+    struct dirstat ds[7];
+    struct stat st;
+    char name[] = "iodir/fa";
+    int dfd, fd, i, n, seen, total;
+
+    printf(1, "getdents/fstatat\n");
+    if(mkdir("iodir") < 0)
+        fail("mkdir failed");
+    for(i = 0; i < 20; i++) {
+        name[7] = 'a' + i;
+        if((fd = open(name, O_CREATE|O_RDWR)) < 0)
+            fail("cannot create file in iodir");
+        write(fd, buf, i);
+        close(fd);
+    }
+    // Leave holes in the directory.
+    for(i = 0; i < 20; i += 3) {
+        name[7] = 'a' + i;
+        unlink(name);
+    }
+
+    dfd = open("iodir", O_RDONLY);
+    seen = total = 0;
+    while((n = getdents(dfd, ds, 7, 1)) > 0) {
+        for(i = 0; i < n; i++, total++) {
+            if(ds[i].name[0] != 'f')
+                continue;
+            if(ds[i].st.type != T_FILE || ds[i].st.size != ds[i].name[1] - 'a')
+                fail("getdents: wrong stat");
+            seen |= 1 << (ds[i].name[1] - 'a');
+        }
+    }
+    if(n < 0 || total != 2 + 13 || seen != 0xb6db6)
+        fail("getdents: wrong entries");
+    if(getdents(dfd, ds, 7, 0) != 0)
+        fail("getdents past the end");
+
+    if(fstatat(dfd, "fb", &st) < 0 || st.type != T_FILE || st.size != 1)
+        fail("fstatat failed");
+    if(fstatat(dfd, "..", &st) < 0 || st.type != T_DIR)
+        fail("fstatat of ..");
+    if(fstatat(dfd, "fa", &st) >= 0)
+        fail("fstatat of a removed file");
+    close(dfd);
+
+    for(i = 0; i < 20; i++) {
+        name[7] = 'a' + i;
+        unlink(name);
+    }
+    if(unlink("iodir") < 0)
+        fail("cannot remove iodir");
+}
+
+int main(int argc, char *argv[]) {
+    ptest();
+    vtest();
+    sendtest();
+    dirtest();
+    printf(1, "iotest ok\n");
+    exit();
+}
@@ -1,6 +1,25 @@
 // Physical memory allocator, intended to allocate
 // memory for user processes, kernel stacks, page table pages,
 // and pipe buffers. Allocates 4096-byte pages.
+//
+// NHUGE 4 MB pages at the top of memory are kept apart for
+// MAP_HUGE mappings (hugealloc). A reference to any 4096-byte
+// part of a huge page counts as a reference to the whole of it,
+// so a huge page that copy-on-write has split into small pages
+// goes back to the huge pool once the last of them is freed.
+//
+// Every frame below phystop has a struct page, in one array set up
+// by kinit1(). The descriptor is kept to 8 bytes, a power of two,
+// so that none straddles a cache line and updating one touches a
+// single line. Links that are only needed while a page is free
+// live in the free page itself (struct run).
+//
+// Free pages are kept on per-CPU lists, each with its own lock.
+// kfree() puts a page on the list of the CPU it runs on, and
+// kalloc() takes from that list first and steals from the others
+// only when it is empty. At boot every CPU hands its own slice of
+// memory to its own list (kinitslice), all at the same time, and
+// free pages are not filled with junk until they have been used.
 
 #include "types.h"
 #include "defs.h"
@@ -8,50 +27,184 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "spinlock.h"
+#include "proc.h"
+#include "x86.h"
 
 void freerange(void *vstart, void *vend);
 extern char end[]; // first address after kernel loaded from ELF file
                    // defined by the kernel linker script in kernel.ld
 
+#define NRECLAIM 32   // page cache pages to free when out of memory
+#define CACHELINE 64
+
+uint phystop;         // end of the physical memory in use
+
 struct run {
     struct run *next;
 };
 
-struct {
+struct page {
+    uint ref;               // references to the frame
+    uint flags;
+};
+
+#define PG_FREE  0x1        // on a free list
+#define PG_HUGE  0x2        // first frame of a huge page; ref counts it all
+
+struct freelist {
     struct spinlock lock;
+    struct run *head;
+    uint n;                         // pages on the list
+};
+
+struct {
+    struct spinlock lock;           // protects pages[] and the huge pool
     int use_lock;
-    struct run *freelist;
+    struct freelist free[NCPU];     // indexed by cpuid()
+    struct page *pages;             // one per frame below phystop
 
-    // Used in fork_cow
-    uint numFreePages;
-    uint pg_refcount[PHYSTOP >> PGSHIFT];
+    struct run *hugelist;
+    char *hugebase;                 // first huge page, or 0
 
+    // The memory kinit2() leaves for the CPUs to free, a slice each.
+    char *bootstart;
+    char *bootend;
+    volatile uint bootready;
 } kmem;
 
+// The calling CPU's free list. Before kinit2() there is only
+// the boot CPU, and no telling yet which one it is.
+static struct freelist* myfree(void) {
+    struct freelist *f;
+
+    if(!kmem.use_lock)
+        return &kmem.free[0];
+    pushcli();
+    f = &kmem.free[cpuid()];
+    popcli();
+    return f;
+}
+
+// Is v in the huge page pool?
+static int ishuge(char *v) {
+    return kmem.hugebase && v >= kmem.hugebase && v < kmem.hugebase + NHUGE*HPGSIZE;
+}
+
+// Descriptor of the (possibly huge) page holding pa.
+static struct page* pageof(uint pa) {
+    if(ishuge(P2V(pa)))
+        pa = HPGROUNDDOWN(pa);
+    return &kmem.pages[pa >> PGSHIFT];
+}
+
 // Initialization happens in two phases.
 // 1. main() calls kinit1() while still using entrypgdir to place just
-// the pages mapped by entrypgdir on free list.
+// the pages mapped by entrypgdir on free list. kinit1() also finds
+// out how much memory there is and puts the struct page array for
+// all of it at vstart.
 // 2. main() calls kinit2() with the rest of the physical pages
 // after installing a full page table that maps them on all cores.
+//
+// Only the memory the kernel can map (PHYSLIMIT) is used.
 void kinit1(void *vstart, void *vend) {
+    uint kb, n;
+    int i;
+
     initlock(&kmem.lock, "kmem");
+    for(i = 0; i < NCPU; i++)
+        initlock(&kmem.free[i].lock, "kmemfree");
     kmem.use_lock = 0;
-    kmem.numFreePages = 0;                              // init free pages to 0
+
+    kb = cmosmemkb();
+    if(kb > PHYSLIMIT / 1024)
+        kb = PHYSLIMIT / 1024;
+    phystop = PGROUNDDOWN(kb * 1024);
+    if((char*)vend > (char*)P2V(phystop))
+        vend = P2V(phystop);
+
+    n = (phystop >> PGSHIFT) * sizeof(struct page);
+    kmem.pages = (struct page*)(((uint)vstart + CACHELINE-1) & ~(CACHELINE-1));
+    vstart = (char*)kmem.pages + n;
+    if((char*)vstart > (char*)vend)
+        panic("kinit1: struct page array");
+    memset(kmem.pages, 0, n);
     freerange(vstart, vend);
 }
 
+// kinit2() sets the huge page pool aside and frees the boot
+// CPU's slice of the rest. The other CPUs, already started,
+// are waiting in kinitslice() to free theirs.
 void kinit2(void *vstart, void *vend) {
-    freerange(vstart, vend);
+    struct run *r;
+    int i;
+
+    kmem.hugebase = (char*)HPGROUNDDOWN((uint)vend) - NHUGE*HPGSIZE;
+    if(kmem.hugebase < (char*)vstart)
+        kmem.hugebase = 0;
+    for(i = 0; kmem.hugebase && i < NHUGE; i++) {
+        r = (struct run*)(kmem.hugebase + i*HPGSIZE);
+        pageof(V2P(r))->flags = PG_HUGE;
+        r->next = kmem.hugelist;
+        kmem.hugelist = r;
+    }
+    kmem.bootstart = (char*)PGROUNDUP((uint)vstart);
+    kmem.bootend = kmem.hugebase ? kmem.hugebase : vend;
+    if(kmem.bootend < kmem.bootstart)
+        kmem.bootend = kmem.bootstart;
     kmem.use_lock = 1;
+    cprintf("mem: %d MB\n", phystop >> 20);
+    xchg(&kmem.bootready, 1);
+    kinitslice();
+}
+
+// Free this CPU's slice of the memory kinit2() left, once
+// kinit2() has said what that is.
+void kinitslice(void) {
+    uint n, id;
+
+    while(kmem.bootready == 0)
+        ;
+    pushcli();
+    id = cpuid();
+    popcli();
+    n = (kmem.bootend - kmem.bootstart) / PGSIZE;
+    freerange(kmem.bootstart + n*id/ncpu*PGSIZE, kmem.bootstart + n*(id+1)/ncpu*PGSIZE);
 }
 
+// Put the pages in [vstart, vend) on this CPU's free list, all at
+// once. Unlike kfree(), leaves their contents alone.
 void freerange(void *vstart, void *vend) {
+    struct freelist *f;
+    struct run *head, *tail, *r;
+    struct page *pg;
     char *p;
+    uint n;
+
+    head = tail = 0;
+    n = 0;
     p = (char*)PGROUNDUP((uint)vstart);
     for(; p + PGSIZE <= (char*)vend; p += PGSIZE) {
-        kmem.pg_refcount[V2P(p) >> PGSHIFT] = 0;        // init the reference count to 0
-        kfree(p);
+        pg = &kmem.pages[V2P(p) >> PGSHIFT];
+        pg->ref = 0;                                    // init the reference count to 0
+        pg->flags = PG_FREE;
+        r = (struct run*)p;
+        r->next = head;
+        head = r;
+        if(tail == 0)
+            tail = r;
+        n++;
     }
+    if(head == 0)
+        return;
+
+    f = myfree();
+    if(kmem.use_lock)
+        acquire(&f->lock);
+    tail->next = f->head;
+    f->head = head;
+    f->n += n;
+    if(kmem.use_lock)
+        release(&f->lock);
 }
 //PAGEBREAK: 21
 // Free the page of physical memory pointed at by v,
@@ -61,87 +214,165 @@ void freerange(void *vstart, void *vend) {
 
 // had to change kfree
 void kfree(char *v) {
+    struct freelist *f;
     struct run *r;
+    struct page *pg;
 
-    if((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP)
+    if((uint)v % PGSIZE || v < end || V2P(v) >= phystop)
         panic("kfree");
 
     if(kmem.use_lock)
         acquire(&kmem.lock);
-    r = (struct run*)v;
 
-    if(kmem.pg_refcount[V2P(v) >> PGSHIFT] > 0)          // Decrement the reference count of a page whenever someone frees it
-        --kmem.pg_refcount[V2P(v) >> PGSHIFT];
+    pg = pageof(V2P(v));
+    if(pg->flags & PG_HUGE) {
+        if(pg->ref == 0)
+            panic("kfree: huge");
+        if(--pg->ref == 0) {
+            r = (struct run*)HPGROUNDDOWN((uint)v);
+            r->next = kmem.hugelist;
+            kmem.hugelist = r;
+        }
+        if(kmem.use_lock)
+            release(&kmem.lock);
+        return;
+    }
+    if(pg->flags & PG_FREE)
+        panic("kfree: page already free");
 
-    if(kmem.pg_refcount[V2P(v) >> PGSHIFT] == 0) {       // Free the page only if there are no references to the page
-        // Fill with junk to catch dangling refs.
-        memset(v, 1, PGSIZE);
-        kmem.numFreePages++;                             // Increment the number of free pages by 1 when a page is freed
-        r->next = kmem.freelist;
-        kmem.freelist = r;
+    if(pg->ref > 0)                                      // Decrement the reference count of a page whenever someone frees it
+        --pg->ref;
 
+    // Free the page only if there are no references to the page.
+    // Once it is marked free the page is ours alone, so the junk
+    // fill and the free list need only the free list's lock.
+    if(pg->ref > 0) {
+        if(kmem.use_lock)
+            release(&kmem.lock);
+        return;
     }
+    pg->flags |= PG_FREE;
     if(kmem.use_lock)
         release(&kmem.lock);
+
+    // Fill with junk to catch dangling refs.
+    memset(v, 1, PGSIZE);
+    r = (struct run*)v;
+    f = myfree();
+    if(kmem.use_lock)
+        acquire(&f->lock);
+    f->n++;                                              // Increment the number of free pages by 1 when a page is freed
+    r->next = f->head;
+    f->head = r;
+    if(kmem.use_lock)
+        release(&f->lock);
+}
+
+// Take a page off this CPU's free list, or else off another
+// CPU's, or return 0.
+static struct run* takefree(void) {
+    struct freelist *mine, *f;
+    struct run *r;
+    int i;
+
+    mine = myfree();
+    for(i = 0; i < NCPU; i++) {
+        f = &kmem.free[(mine - kmem.free + i) % NCPU];
+        if(f->head == 0)
+            continue;
+        if(kmem.use_lock)
+            acquire(&f->lock);
+        if((r = f->head) != 0) {
+            f->head = r->next;
+            f->n--;                                      // Decrement the number of free pages by 1 on a page allocation
+        }
+        if(kmem.use_lock)
+            release(&f->lock);
+        if(r)
+            return r;
+    }
+    return 0;
 }
 
 // Allocate one 4096-byte page of physical memory.
 // Returns a pointer that the kernel can use.
 // Returns 0 if the memory cannot be allocated.
+// When no page is free, idle pages are taken back from the
+// page cache first. When few are, kswapd is woken to free more.
 char* kalloc(void) {
     struct run *r;
 
-    if(kmem.use_lock)
-        acquire(&kmem.lock);
-    r = kmem.freelist;
+    r = takefree();
+    if(r == 0 && kmem.use_lock) {
+        pcreclaim(NRECLAIM);
+        r = takefree();
+    }
+    if(kmem.use_lock && getNumFreePages() < SWAPLOW)
+        swapkick();
     if(r) {
-        kmem.freelist = r->next;
-        kmem.numFreePages--;                               // Decrement the number of free pages by 1 on a page allocation
-        kmem.pg_refcount[V2P((char*)r) >> PGSHIFT] = 1;    // reference count of a page is set to one when it is allocated
+        kmem.pages[V2P((char*)r) >> PGSHIFT].ref = 1;      // reference count of a page is set to one when it is allocated
+        kmem.pages[V2P((char*)r) >> PGSHIFT].flags &= ~PG_FREE;
     }
-    if(kmem.use_lock)
-        release(&kmem.lock);
+    return (char*)r;
+}
+
+// Allocate one 4 MB page from the huge page pool, or return 0.
+char* hugealloc(void) {
+    struct run *r;
+
+    acquire(&kmem.lock);
+    if((r = kmem.hugelist) != 0) {
+        kmem.hugelist = r->next;
+        pageof(V2P(r))->ref = 1;
+    }
+    release(&kmem.lock);
     return (char*)r;
 }
 
 // Returns the number of free pages.
 uint getNumFreePages(void) {
-    if(kmem.use_lock)
-        acquire(&kmem.lock);
-    uint r = kmem.numFreePages;
-    if(kmem.use_lock)
-        release(&kmem.lock);
+    uint r;
+    int i;
+
+    r = 0;
+    for(i = 0; i < NCPU; i++)
+        r += kmem.free[i].n;
     return (r);
 }
 
-// Decrement the applicable reference counter
-void decrementReferenceCount(uint pa) {
-    if(pa < (int)V2P(end) || pa >= PHYSTOP)
+// Decrement the applicable reference counter and return what
+// is left of it
+uint decrementReferenceCount(uint pa) {
+    uint count;
+
+    if(pa < (int)V2P(end) || pa >= phystop)
         panic("decrementReferenceCount");
 
     acquire(&kmem.lock);
-    --kmem.pg_refcount[pa >> PGSHIFT];
+    count = --pageof(pa)->ref;
     release(&kmem.lock);
+
+    return count;
 }
 
 // Increment the applicable reference counter
 void incrementReferenceCount(uint pa) {
-    if(pa < (int)V2P(end) || pa >= PHYSTOP)
+    if(pa < (int)V2P(end) || pa >= phystop)
         panic("incrementReferenceCount");
 
     acquire(&kmem.lock);
-    ++kmem.pg_refcount[pa >> PGSHIFT];
+    ++pageof(pa)->ref;
     release(&kmem.lock);
 }
 
 // Return the applicable reference counter
 uint getReferenceCount(uint pa) {
-    if(pa < (int)V2P(end) || pa >= PHYSTOP)
+    if(pa < (int)V2P(end) || pa >= phystop)
         panic("getReferenceCount");
 
     uint count;
     acquire(&kmem.lock);
-    count = kmem.pg_refcount[pa >> PGSHIFT];
+    count = pageof(pa)->ref;
     release(&kmem.lock);
 
     return count;
@@ -9,6 +9,8 @@
 #include "traps.h"
 #include "mmu.h"
 #include "x86.h"
+#include "proc.h"
+#include "vdso.h"
 
 // Local APIC registers, divided by 4 for use as uint[] indices.
 #define ID      (0x0020/4)   // ID
@@ -42,6 +44,7 @@
 #define TDCR    (0x03E0/4)   // Timer Divide Configuration
 
 volatile uint *lapic;  // Initialized in mp.c
+static uint lapicticr;  // timer counts per clock tick
 
 //PAGEBREAK!
 static void lapicw(int index, int value) {
@@ -49,6 +52,31 @@ static void lapicw(int index, int value) {
     lapic[ID]; // wait for write to finish, by reading
 }
 
+// I/O ports of the 8253 programmable interval timer.
+#define PIT_HZ       1193182
+#define PIT_CH2      0x42
+#define PIT_CMD      0x43
+#define PIT_GATE     0x61   // bit 0: channel 2 gate; bit 5: channel 2 output
+
+// Count how far the LAPIC timer runs down in one clock tick,
+// using PIT channel 2 in one-shot mode as the reference.
+static uint lapiccalibrate(void) {
+    uint pitcount, start;
+
+    pitcount = PIT_HZ / (1000000000 / TICKNS);
+    outb(PIT_GATE, (inb(PIT_GATE) & ~0x02) | 0x01);  // speaker off, gate on
+    outb(PIT_CMD, 0xB0);                             // channel 2, mode 0
+    outb(PIT_CH2, pitcount & 0xFF);
+    outb(PIT_CH2, pitcount >> 8);
+
+    lapicw(TIMER, MASKED);
+    lapicw(TICR, 0xFFFFFFFF);
+    start = lapic[TCCR];
+    while((inb(PIT_GATE) & 0x20) == 0)
+        ;
+    return start - lapic[TCCR];
+}
+
 void lapicinit(void) {
     if(!lapic)
         return;
@@ -58,11 +86,13 @@ void lapicinit(void) {
 
     // The timer repeatedly counts down at bus frequency
     // from lapic[TICR] and then issues an interrupt.
-    // If xv6 cared more about precise timekeeping,
-    // TICR would be calibrated using an external time source.
+    // The boot processor calibrates TICR against the PIT
+    // so that a tick is TICKNS nanoseconds long.
     lapicw(TDCR, X1);
+    if(lapicticr == 0 && (lapicticr = lapiccalibrate()) == 0)
+        lapicticr = 10000000;
     lapicw(TIMER, PERIODIC | (T_IRQ0 + IRQ_TIMER));
-    lapicw(TICR, 10000000);
+    lapicw(TICR, lapicticr);
 
     // Disable logical interrupt lines.
     lapicw(LINT0, MASKED);
@@ -105,10 +135,73 @@ void lapiceoi(void) {
         lapicw(EOI, 0);
 }
 
+// Have this CPU's timer interrupt at TSC value deadline, as
+// well as at the end of each tick, if that comes first. The
+// timer goes into one-shot mode to interrupt early, and
+// lapictimer() then runs it out to the tick boundary before
+// putting it back in periodic mode. Interrupts are off.
+void lapicarm(uint64 deadline) {
+    struct cpu *c = mycpu();
+    uint64 now;
+    uint tpu, counts, rem;
+
+    // TSC cycles per microsecond, once vdsotick() knows.
+    if(!lapic || vdata == 0 || (tpu = vdata->tscpertick / (TICKNS/1000)) == 0)
+        return;
+    now = rdtsc();
+    counts = 0;
+    if(deadline > now) {
+        if(deadline - now >= vdata->tscpertick)
+            return;
+        counts = ((uint)(deadline - now) / tpu + 1) * (lapicticr / (TICKNS/1000));
+    }
+    if(counts == 0)
+        counts = 1;
+
+    // rem counts to go until the next interrupt, which is the
+    // tick unless c->tickleft says how far beyond it that is.
+    rem = lapic[TCCR];
+    if(counts >= rem)
+        return;
+    c->tickleft += rem - counts;
+    c->oneshot = 1;
+    lapicw(TIMER, T_IRQ0 + IRQ_TIMER);
+    lapicw(TICR, counts);
+}
+
+// This CPU's timer interrupted. Returns 1 at the end of a
+// clock tick, or 0 for an early interrupt from lapicarm().
+int lapictimer(void) {
+    struct cpu *c;
+
+    if(!lapic)
+        return 1;
+    c = mycpu();
+    if(c->tickleft) {
+        lapicw(TICR, c->tickleft);
+        c->tickleft = 0;
+        return 0;
+    }
+    if(c->oneshot) {
+        lapicw(TIMER, PERIODIC | (T_IRQ0 + IRQ_TIMER));
+        lapicw(TICR, lapicticr);
+        c->oneshot = 0;
+    }
+    return 1;
+}
+
 // Spin for a given number of microseconds.
 // On real hardware would want to tune this dynamically.
 void microdelay(int us) {}
 
+// Send interrupt vector to the CPU with the given APIC ID.
+void lapicipi(uchar apicid, int vector) {
+    lapicw(ICRHI, apicid<<24);
+    lapicw(ICRLO, FIXED | ASSERT | vector);
+    while(lapic[ICRLO] & DELIVS)
+        ;
+}
+
 #define CMOS_PORT    0x70
 #define CMOS_RETURN  0x71
 
@@ -165,6 +258,23 @@ static uint cmos_read(uint reg) {
     return inb(CMOS_RETURN);
 }
 
+#define CMOS_EXTLO   0x30    // KB of memory above 1 MB, up to 64 MB
+#define CMOS_EXTHI   0x31
+#define CMOS_EXT16LO 0x34    // 64 KB blocks of memory above 16 MB
+#define CMOS_EXT16HI 0x35
+
+// Amount of memory below 4 GB, in KB, as the BIOS left it in
+// the CMOS.
+uint cmosmemkb(void) {
+    uint n;
+
+    n = cmos_read(CMOS_EXT16LO) | cmos_read(CMOS_EXT16HI) << 8;
+    if(n)
+        return 16*1024 + n*64;
+    n = cmos_read(CMOS_EXTLO) | cmos_read(CMOS_EXTHI) << 8;
+    return 1024 + n;
+}
+
 static void fill_rtcdate(struct rtcdate *r) {
     r->second = cmos_read(SECS);
     r->minute = cmos_read(MINS);
@@ -20,10 +20,13 @@ char* fmtname(char *path) {
     return buf;
 }
 
+// Directory entries fetched per getdents() call.
+#define NENT 64
+
+struct dirstat ents[NENT];
+
 void ls(char *path) {
-    char buf[512], *p;
-    int fd;
-    struct dirent de;
+    int fd, i, n;
     struct stat st;
 
     if((fd = open(path, 0)) < 0) {
@@ -43,24 +46,14 @@ void ls(char *path) {
         break;
 
     case T_DIR:
-        if(strlen(path) + 1 + DIRSIZ + 1 > sizeof buf) {
-            printf(1, "ls: path too long\n");
-            break;
-        }
-        strcpy(buf, path);
-        p = buf+strlen(buf);
-        *p++ = '/';
-        while(read(fd, &de, sizeof(de)) == sizeof(de)) {
-            if(de.inum == 0)
-                continue;
-            memmove(p, de.name, DIRSIZ);
-            p[DIRSIZ] = 0;
-            if(stat(buf, &st) < 0) {
-                printf(1, "ls: cannot stat %s\n", buf);
-                continue;
-            }
-            printf(1, "%s %d %d %d\n", fmtname(buf), st.type, st.ino, st.size);
-        }
+        // getdents() stats the entries as it goes, so there is no
+        // need to build a path and stat() each one.
+        while((n = getdents(fd, ents, NENT, 1)) > 0)
+            for(i = 0; i < n; i++)
+                printf(1, "%s %d %d %d\n", fmtname(ents[i].name),
+                       ents[i].st.type, ents[i].st.ino, ents[i].st.size);
+        if(n < 0)
+            printf(1, "ls: cannot read %s\n", path);
         break;
     }
     close(fd);
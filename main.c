@@ -15,7 +15,9 @@ extern char end[]; // first address after kernel loaded from ELF file
 // Allocate a real stack and switch to it, first
 // doing some setup required for memory allocator to work.
 int main(void) {
-    kinit1(end, P2V(4*1024*1024)); // phys page allocator
+    uint64 t0 = rdtsc();
+
+    kinit1(end, P2V(8*1024*1024)); // phys page allocator
     kvmalloc();    // kernel page table
     mpinit();      // detect other processors
     lapicinit();   // interrupt controller
@@ -24,14 +26,21 @@ int main(void) {
     ioapicinit();  // another interrupt controller
     consoleinit(); // console hardware
     uartinit();    // serial port
+    slabinit();    // small-object caches
     pinit();       // process table
+    vdsoinit();    // kernel data page
     tvinit();      // trap vectors
+    timerinit();   // timer wheel
     binit();       // buffer cache
+    pcacheinit();  // page cache
     fileinit();    // file table
+    pipeinit();    // pipe cache
     ideinit();     // disk
     startothers(); // start other processors
-    kinit2(P2V(4*1024*1024), P2V(PHYSTOP)); // must come after startothers()
+    kinit2(P2V(8*1024*1024), P2V(phystop)); // must come after startothers()
+    cprintf("boot: %d Mcycles to userinit\n", (uint)((rdtsc() - t0) >> 20));
     userinit();    // first user process
+    kthread("kswapd", kswapd); // page-out daemon
     mpmain();      // finish this processor's setup
 }
 
@@ -40,6 +49,10 @@ static void mpenter(void) {
     switchkvm();
     seginit();
     lapicinit();
+    // Done with entryother's stack and code: let startothers() go
+    // on to the next CPU while this one frees its share of memory.
+    xchg(&(mycpu()->started), 1);
+    kinitslice();
     mpmain();
 }
 
@@ -47,7 +60,6 @@ static void mpenter(void) {
 static void mpmain(void) {
     cprintf("cpu%d: starting %d\n", cpuid(), cpuid());
     idtinit();     // load idt register
-    xchg(&(mycpu()->started), 1); // tell startothers() we're up
     scheduler();   // start running processes
 }
 
@@ -80,7 +92,7 @@ static void startothers(void) {
 
         lapicstartap(c->apicid, V2P(code));
 
-        // wait for cpu to finish mpmain()
+        // wait for cpu to reach mpenter()
         while(c->started == 0)
             ;
     }
@@ -95,8 +107,10 @@ __attribute__((__aligned__(PGSIZE)))
 pde_t entrypgdir[NPDENTRIES] = {
     // Map VA's [0, 4MB) to PA's [0, 4MB)
     [0] = (0) | PTE_P | PTE_W | PTE_PS,
-    // Map VA's [KERNBASE, KERNBASE+4MB) to PA's [0, 4MB)
+    // Map VA's [KERNBASE, KERNBASE+8MB) to PA's [0, 8MB), leaving
+    // room after the kernel for kinit1's struct page array
     [KERNBASE>>PDXSHIFT] = (0) | PTE_P | PTE_W | PTE_PS,
+    [(KERNBASE>>PDXSHIFT)+1] = (4*1024*1024) | PTE_P | PTE_W | PTE_PS,
 };
 
 //PAGEBREAK!
@@ -0,0 +1,117 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+// Allocator microbenchmark: times a few common malloc/free
+// patterns in clock ticks and checks that the heap is handed
+// back to the kernel afterwards.
+
+#define NOPS    200000
+#define NLIVE   2000
+
+static uint seed = 1;
+
+static uint rnd(void) {
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 16) & 0x7fff;
+}
+
+static void* slots[NLIVE];
+
+// Allocate and immediately free one small object.
+static void pairs(void) {
+    int i;
+    char *p;
+
+    for(i = 0; i < NOPS; i++) {
+        if((p = malloc(1 + rnd() % 256)) == 0) {
+            printf(1, "mallocbench: out of memory\n");
+            exit();
+        }
+        *p = 1;
+        free(p);
+    }
+}
+
+// Keep NLIVE objects of mixed size alive, replacing one at random.
+static void churn(void) {
+    int i, j;
+
+    for(i = 0; i < NOPS; i++) {
+        j = rnd() % NLIVE;
+        free(slots[j]);
+        slots[j] = malloc(1 + rnd() % 2048);
+        if(slots[j] == 0) {
+            printf(1, "mallocbench: out of memory\n");
+            exit();
+        }
+    }
+    for(j = 0; j < NLIVE; j++) {
+        free(slots[j]);
+        slots[j] = 0;
+    }
+}
+
+// Large blocks that go straight to page runs.
+static void large(void) {
+    int i;
+    char *p;
+
+    for(i = 0; i < NOPS / 100; i++) {
+        if((p = malloc(4096 * (1 + rnd() % 16))) == 0) {
+            printf(1, "mallocbench: out of memory\n");
+            exit();
+        }
+        p[0] = 1;
+        free(p);
+    }
+}
+
+// Grow a buffer one step at a time with realloc.
+static void grow(void) {
+    int i;
+    char *p;
+
+    p = 0;
+    for(i = 1; i <= 64 * 1024; i += 64) {
+        if((p = realloc(p, i)) == 0) {
+            printf(1, "mallocbench: realloc failed\n");
+            exit();
+        }
+        p[i-1] = 1;
+    }
+    free(p);
+}
+
+static void run(char *name, void (*fn)(void)) {
+    uint t0;
+
+    t0 = uptime();
+    fn();
+    printf(1, "%s: %d ticks\n", name, uptime() - t0);
+}
+
+int main(int argc, char *argv[]) {
+    char *brk0;
+    int *z;
+    int i;
+
+    brk0 = sbrk(0);
+
+    run("malloc/free pairs", pairs);
+    run("mixed live set", churn);
+    run("large blocks", large);
+    run("realloc growth", grow);
+
+    z = calloc(1000, sizeof(int));
+    for(i = 0; i < 1000; i++) {
+        if(z[i] != 0) {
+            printf(1, "mallocbench: calloc memory not zeroed\n");
+            exit();
+        }
+    }
+    free(z);
+
+    printf(1, "heap grew by %d bytes\n", sbrk(0) - brk0);
+    exit();
+}
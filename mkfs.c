@@ -95,6 +95,8 @@ int main(int argc, char *argv[]) {
     sb.logstart = xint(2);
     sb.inodestart = xint(2+nlog);
     sb.bmapstart = xint(2+nlog+ninodeblocks);
+    sb.swapstart = xint(FSSIZE);
+    sb.nswap = xint(NSWAP);
 
     printf("nmeta %d (boot, super, log blocks %u inode blocks %u, bitmap blocks %u) blocks %d total %d\n",
            nmeta, nlog, ninodeblocks, nbitmap, nblocks, FSSIZE);
@@ -104,6 +106,10 @@ int main(int argc, char *argv[]) {
     for(i = 0; i < FSSIZE; i++)
         wsect(i, zeroes);
 
+    // The swap area needs no contents; writing its last block
+    // makes the image big enough to hold it.
+    wsect(FSSIZE + NSWAP*SWAPBPP - 1, zeroes);
+
     memset(buf, 0, sizeof(buf));
     memmove(buf, &sb, sizeof(sb));
     wsect(1, buf);
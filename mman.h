@@ -0,0 +1,10 @@
+// mmap() protection and flags
+#define PROT_READ       0x1
+#define PROT_WRITE      0x2
+
+#define MAP_SHARED      0x01    // changes go to the file / are seen by children
+#define MAP_PRIVATE     0x02    // changes are private copy-on-write
+#define MAP_ANONYMOUS   0x20    // zero-filled, no file
+#define MAP_HUGE        0x40000 // use 4 MB pages where possible (anonymous only)
+
+#define MAP_FAILED      ((void*)-1)
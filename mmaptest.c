@@ -0,0 +1,201 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "mman.h"
+
+// Tests for mmap() and munmap().
+
+void fail(char *msg) {
+    printf(1, "mmaptest: %s\n", msg);
+    exit();
+}
+
+// Anonymous private memory is zeroed, writable, and gone
+// after munmap.
+void anontest(void) {
+    char *p;
+    int i, pid;
+
+    printf(1, "anonymous mapping\n");
+    p = mmap(0, 10*4096, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if(p == MAP_FAILED)
+        fail("anonymous mmap failed");
+    for(i = 0; i < 10*4096; i++)
+        if(p[i] != 0)
+            fail("anonymous memory not zeroed");
+    for(i = 0; i < 10*4096; i++)
+        p[i] = i;
+    for(i = 0; i < 10*4096; i++)
+        if(p[i] != (char)i)
+            fail("anonymous memory lost a write");
+    if(munmap(p, 10*4096) < 0)
+        fail("munmap failed");
+
+    pid = fork();
+    if(pid == 0) {
+        p[0] = 1;
+        fail("write to unmapped memory succeeded");
+    }
+    wait();
+    printf(1, "anonymous mapping ok\n");
+}
+
+// A private file mapping reads the file, and writes to it
+// affect neither the file nor other processes.
+void privatetest(void) {
+    char *p, buf[512];
+    int fd, n, i, pid;
+
+    printf(1, "private file mapping\n");
+    fd = open("README", O_RDONLY);
+    if(fd < 0)
+        fail("open README failed");
+    p = mmap(0, 8192, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if(p == MAP_FAILED)
+        fail("file mmap failed");
+    n = read(fd, buf, sizeof(buf));
+    close(fd);
+    for(i = 0; i < n; i++)
+        if(p[i] != buf[i])
+            fail("mapping differs from file");
+
+    pid = fork();
+    if(pid == 0) {
+        p[0] = 'X';
+        exit();
+    }
+    wait();
+    if(p[0] != buf[0])
+        fail("child's write showed up in parent");
+    p[0] = 'Y';
+    munmap(p, 8192);
+
+    fd = open("README", O_RDONLY);
+    read(fd, buf, 1);
+    close(fd);
+    if(buf[0] == 'Y')
+        fail("private write reached the file");
+    printf(1, "private file mapping ok\n");
+}
+
+// A shared file mapping writes back to the file, and a shared
+// anonymous mapping is shared with children.
+void sharedtest(void) {
+    char *p, buf[64];
+    int fd, i, pid;
+
+    printf(1, "shared mapping\n");
+    fd = open("mmapfile", O_CREATE|O_RDWR);
+    if(fd < 0)
+        fail("create failed");
+    for(i = 0; i < sizeof(buf); i++)
+        buf[i] = 'a';
+    for(i = 0; i < 100; i++)
+        write(fd, buf, sizeof(buf));
+    p = mmap(0, 6400, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    if(p == MAP_FAILED)
+        fail("shared mmap failed");
+    close(fd);
+    for(i = 0; i < 6400; i += 2)
+        p[i] = 'b';
+    munmap(p, 6400);
+
+    fd = open("mmapfile", O_RDONLY);
+    for(i = 0; i < 100; i++) {
+        if(read(fd, buf, sizeof(buf)) != sizeof(buf))
+            fail("short read of mmapfile");
+        if(buf[0] != 'b' || buf[1] != 'a')
+            fail("shared write not written back");
+    }
+    close(fd);
+    unlink("mmapfile");
+
+    p = mmap(0, 4096, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+    if(p == MAP_FAILED)
+        fail("shared anonymous mmap failed");
+    p[0] = 1;
+    pid = fork();
+    if(pid == 0) {
+        p[0] = 2;
+        exit();
+    }
+    wait();
+    if(p[0] != 2)
+        fail("child's write to shared memory not seen");
+    munmap(p, 4096);
+    printf(1, "shared mapping ok\n");
+}
+
+// A read-only mapping can't be written, by the program or by
+// a system call on its behalf.
+void readonlytest(void) {
+    char *p;
+    int fd, pid;
+
+    printf(1, "read-only mapping\n");
+    fd = open("README", O_RDONLY);
+    p = mmap(0, 4096, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(p == MAP_FAILED)
+        fail("read-only mmap failed");
+    pid = fork();
+    if(pid == 0) {
+        p[0] = 'Z';
+        fail("write to read-only mapping succeeded");
+    }
+    wait();
+    fd = open("README", O_RDONLY);
+    if(read(fd, p, 10) != -1)
+        fail("read into read-only mapping succeeded");
+    close(fd);
+    munmap(p, 4096);
+    printf(1, "read-only mapping ok\n");
+}
+
+// A MAP_HUGE mapping is 4 MB aligned, zeroed, and copy-on-write
+// across fork() like any other private memory.
+void hugetest(void) {
+    char *p;
+    int i, pid;
+
+    printf(1, "huge mapping\n");
+    p = mmap(0, 5*1024*1024, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGE, -1, 0);
+    if(p == MAP_FAILED)
+        fail("huge mmap failed");
+    if((uint)p % (4*1024*1024))
+        fail("huge mapping not 4 MB aligned");
+    for(i = 0; i < 8*1024*1024; i += 4096)
+        if(p[i] != 0)
+            fail("huge memory not zeroed");
+    for(i = 0; i < 8*1024*1024; i += 4096)
+        p[i] = i >> 12;
+
+    pid = fork();
+    if(pid == 0) {
+        for(i = 0; i < 8*1024*1024; i += 4096)
+            if(p[i] != (char)(i >> 12))
+                fail("child does not see parent's huge memory");
+        p[4096] = 'c';
+        exit();
+    }
+    wait();
+    if(p[4096] != 1)
+        fail("child's write to huge memory showed up in parent");
+    p[4096] = 'p';
+    if(munmap(p + 4096, 4096) == 0)
+        fail("munmap of part of a huge page succeeded");
+    if(munmap(p, 8*1024*1024) < 0)
+        fail("huge munmap failed");
+    printf(1, "huge mapping ok\n");
+}
+
+int main(void) {
+    anontest();
+    privatetest();
+    sharedtest();
+    readonlytest();
+    hugetest();
+    printf(1, "mmaptest ok\n");
+    exit();
+}
@@ -11,16 +11,27 @@
 
 #define CR4_PSE         0x00000010      // Page size extension
 
+// Model-specific registers for sysenter/sysexit
+#define MSR_SYSENTER_CS  0x174
+#define MSR_SYSENTER_ESP 0x175
+#define MSR_SYSENTER_EIP 0x176
+
+// CPUID leaf 1 %edx feature bits
+#define CPUID_SEP       0x00000800      // sysenter/sysexit
+
 // various segment selectors.
+// sysenter and sysexit need KCODE, KDATA, UCODE and UDATA in
+// that order, one after the other.
 #define SEG_KCODE 1  // kernel code
 #define SEG_KDATA 2  // kernel data+stack
-#define SEG_KCPU  3  // kernel per-cpu data
-#define SEG_UCODE 4  // user code
-#define SEG_UDATA 5  // user data+stack
+#define SEG_UCODE 3  // user code
+#define SEG_UDATA 4  // user data+stack
+#define SEG_KCPU  5  // kernel per-cpu data
 #define SEG_TSS   6  // this process's task state
+#define SEG_UCPU  7  // never loaded; its limit is the CPU's number
 
 // cpu->gdt[NSEGS] holds the above segments.
-#define NSEGS     7
+#define NSEGS     8
 
 #ifndef __ASSEMBLER__
 // Segment Descriptor
@@ -84,6 +95,7 @@ struct segdesc {
 #define NPDENTRIES      1024    // # directory entries per page directory
 #define NPTENTRIES      1024    // # PTEs per page table
 #define PGSIZE          4096    // bytes mapped by a page
+#define HPGSIZE   (PGSIZE*NPTENTRIES) // bytes mapped by a 4 MB (PTE_PS) page
 
 #define PTXSHIFT        12      // offset of PTX in a linear address
 #define PDXSHIFT        22      // offset of PDX in a linear address
@@ -93,12 +105,21 @@ struct segdesc {
 
 #define PGROUNDUP(sz)  (((sz)+PGSIZE-1) & ~(PGSIZE-1))
 #define PGROUNDDOWN(a) (((a)) & ~(PGSIZE-1))
+#define HPGROUNDUP(sz)  (((sz)+HPGSIZE-1) & ~(HPGSIZE-1))
+#define HPGROUNDDOWN(a) (((a)) & ~(HPGSIZE-1))
 
 // Page table/directory entry flags.
 #define PTE_P           0x001   // Present
 #define PTE_W           0x002   // Writeable
 #define PTE_U           0x004   // User
+#define PTE_A           0x020   // Accessed
+#define PTE_D           0x040   // Dirty
 #define PTE_PS          0x080   // Page Size
+#define PTE_SWAP        0x200   // Swapped out; see swap.c (software)
+
+// Page fault error code bits
+#define FEC_WR          0x002   // Page fault caused by a write
+#define FEC_U           0x004   // Fault happened in user mode
 
 // Address in page table or page directory entry
 #define PTE_ADDR(pte)   ((uint)(pte) & ~0xFFF)
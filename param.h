@@ -1,13 +1,18 @@
-#define NPROC        64  // maximum number of processes
+#define NPROC        64  // processes reported by getpinfo
 #define KSTACKSIZE 4096  // size of per-process kernel stack
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
-#define NFILE       100  // open files per system
-#define NINODE       50  // maximum number of active i-nodes
+#define NVMA         16  // demand-paged regions per process
+#define NINODE       50  // maximum number of idle i-nodes kept cached
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
 #define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
-#define FSSIZE       1000  // size of file system in blocks
+#define FSSIZE       4000  // size of file system in blocks
+#define NSWAP       65536  // pages of swap space after the file system
+#define SWAPLOW        64  // wake kswapd below this many free pages
+#define SWAPHIGH      256  // and let it free this many
+#define NHUGE           8  // 4 MB pages set aside for MAP_HUGE
+#define TICKNS   10000000  // nanoseconds per clock tick
@@ -0,0 +1,267 @@
+// Page cache.
+//
+// The page cache holds the contents of files in whole 4096-byte
+// pages, so that file data does not have to squeeze through the
+// small buffer cache, which is left to metadata (inodes, bitmap
+// and indirect blocks, the log).
+//
+//   + Each inode has a radix tree of its cached pages, keyed on
+//     the page index (file offset / PGSIZE). PCLEVELS levels of
+//     PCFAN slots cover files far larger than MAXFILE.
+//   + readi() and writei() copy through the cache; exec and mmap
+//     map cached frames straight into user page tables (see
+//     vmafill in vm.c).
+//   + Program segments need not start on a page boundary in the
+//     file (the stock binaries' one segment is at offset 0x80),
+//     so a second tree, ip->text, holds copies of the file data
+//     starting ip->textoff bytes into each page, for exec to map
+//     (see itext in fs.c). writei() drops those rather than
+//     patch them.
+//   + A cached page holds a kalloc reference of its own (see
+//     pg_refcount). Everyone else using a page, whether a reader
+//     in the middle of a copy or a page table mapping it, holds
+//     another, so a page with a count of 1 is idle.
+//   + The cache grows into otherwise free memory. When kalloc()
+//     runs out of pages it calls pcreclaim(), which frees idle
+//     pages, least recently used first.
+//
+// pcache.lock protects every inode's tree and the LRU list. Pages
+// are filled (in fs.c) with ip->lock held, so a page is never
+// read in twice. Writes are written through to the disk blocks by
+// writei(), so cached pages are never dirty and can be dropped at
+// any time.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+
+#define PCBITS    6
+#define PCFAN     (1 << PCBITS)
+#define PCLEVELS  2
+
+struct pcnode {
+    void *slot[PCFAN];      // child pcnodes, or pcpages at the bottom
+};
+
+struct pcpage {
+    struct inode *ip;
+    struct pcnode **root;   // &ip->pages or &ip->text
+    uint pgno;
+    char *data;
+    struct pcpage *next;    // LRU list
+    struct pcpage *prev;
+};
+
+struct {
+    struct spinlock lock;
+    struct kmem_cache *nodes;
+    struct kmem_cache *pages;
+
+    // Linked list of all cached pages, through prev/next.
+    // head.next is most recently used.
+    struct pcpage head;
+    uint npages;
+} pcache;
+
+void pcacheinit(void) {
+    initlock(&pcache.lock, "pcache");
+    pcache.nodes = kmem_cache_create("pcnode", sizeof(struct pcnode), 0);
+    pcache.pages = kmem_cache_create("pcpage", sizeof(struct pcpage), 0);
+    pcache.head.next = pcache.head.prev = &pcache.head;
+}
+
+// Return the address of the slot for page pgno in the tree at
+// root, creating interior nodes if create is set. Caller holds
+// pcache.lock.
+static struct pcpage** pcslot(struct pcnode **root, uint pgno, int create) {
+    struct pcnode **np;
+    int level;
+
+    if(pgno >> (PCBITS * PCLEVELS))
+        return 0;
+    np = root;
+    for(level = PCLEVELS - 1; ; level--) {
+        if(*np == 0) {
+            if(!create || (*np = kmem_cache_alloc(pcache.nodes)) == 0)
+                return 0;
+            memset(*np, 0, sizeof(struct pcnode));
+        }
+        if(level == 0)
+            return (struct pcpage**)&(*np)->slot[pgno & (PCFAN-1)];
+        np = (struct pcnode**)&(*np)->slot[(pgno >> (PCBITS * level)) & (PCFAN-1)];
+    }
+}
+
+static void lru_unlink(struct pcpage *pg) {
+    pg->next->prev = pg->prev;
+    pg->prev->next = pg->next;
+}
+
+static void lru_push(struct pcpage *pg) {
+    pg->next = pcache.head.next;
+    pg->prev = &pcache.head;
+    pcache.head.next->prev = pg;
+    pcache.head.next = pg;
+}
+
+// Remove pg from the cache and drop the cache's reference.
+// Caller holds pcache.lock.
+static void pcevict(struct pcpage *pg) {
+    *pcslot(pg->root, pg->pgno, 0) = 0;
+    lru_unlink(pg);
+    pcache.npages--;
+    kfree(pg->data);
+    kmem_cache_free(pcache.pages, pg);
+}
+
+// Look up page pgno in the tree at root and take a reference
+// for the caller. Caller holds pcache.lock.
+static char* lookup(struct pcnode **root, uint pgno) {
+    struct pcpage **slot, *pg;
+
+    if((slot = pcslot(root, pgno, 0)) == 0 || (pg = *slot) == 0)
+        return 0;
+    lru_unlink(pg);
+    lru_push(pg);
+    incrementReferenceCount(V2P(pg->data));
+    return pg->data;
+}
+
+// Put page in the tree at root as page pgno of ip. Caller holds
+// pcache.lock.
+static int insert(struct inode *ip, struct pcnode **root, uint pgno, char *page) {
+    struct pcpage **slot, *pg;
+
+    if((slot = pcslot(root, pgno, 1)) == 0 || *slot != 0)
+        return -1;
+    if((pg = kmem_cache_alloc(pcache.pages)) == 0)
+        return -1;
+    pg->ip = ip;
+    pg->root = root;
+    pg->pgno = pgno;
+    pg->data = page;
+    incrementReferenceCount(V2P(page));
+    *slot = pg;
+    lru_push(pg);
+    pcache.npages++;
+    return 0;
+}
+
+// Return the cached page pgno of ip, with a new reference
+// taken for the caller, or 0 if it is not cached.
+char* pclookup(struct inode *ip, uint pgno) {
+    char *data;
+
+    acquire(&pcache.lock);
+    data = lookup(&ip->pages, pgno);
+    release(&pcache.lock);
+    return data;
+}
+
+// Remember page as holding page pgno of ip. The cache takes a
+// reference of its own. Returns -1 if there was no memory for
+// the bookkeeping, in which case page simply isn't cached.
+int pcinsert(struct inode *ip, uint pgno, char *page) {
+    int r;
+
+    acquire(&pcache.lock);
+    r = insert(ip, &ip->pages, pgno, page);
+    release(&pcache.lock);
+    return r;
+}
+
+// Like pclookup(), for the copy of ip's data starting at off,
+// which is not page-aligned.
+char* pctextlookup(struct inode *ip, uint off) {
+    char *data;
+
+    data = 0;
+    acquire(&pcache.lock);
+    if(ip->text && ip->textoff == off % PGSIZE)
+        data = lookup(&ip->text, off / PGSIZE);
+    release(&pcache.lock);
+    return data;
+}
+
+// Like pcinsert(), for the copy of ip's data starting at off.
+// The tree holds one alignment at a time, the first one asked
+// for; pages at other offsets are not cached.
+int pctextinsert(struct inode *ip, uint off, char *page) {
+    int r;
+
+    r = -1;
+    acquire(&pcache.lock);
+    if(ip->text == 0)
+        ip->textoff = off % PGSIZE;
+    if(ip->textoff == off % PGSIZE)
+        r = insert(ip, &ip->text, off / PGSIZE, page);
+    release(&pcache.lock);
+    return r;
+}
+
+static void pcfree(struct pcnode *n, int level) {
+    int i;
+
+    for(i = 0; i < PCFAN; i++) {
+        if(n->slot[i] == 0)
+            continue;
+        if(level == 0)
+            pcevict(n->slot[i]);
+        else
+            pcfree(n->slot[i], level - 1);
+    }
+    kmem_cache_free(pcache.nodes, n);
+}
+
+// Forget all cached pages of ip. Pages still mapped by processes
+// stay with them.
+void pcdrop(struct inode *ip) {
+    acquire(&pcache.lock);
+    if(ip->pages) {
+        pcfree(ip->pages, PCLEVELS - 1);
+        ip->pages = 0;
+    }
+    release(&pcache.lock);
+    pctextdrop(ip);
+}
+
+// Forget ip's unaligned copies (pctextinsert), which a write to
+// the file would leave out of date.
+void pctextdrop(struct inode *ip) {
+    acquire(&pcache.lock);
+    if(ip->text) {
+        pcfree(ip->text, PCLEVELS - 1);
+        ip->text = 0;
+    }
+    release(&pcache.lock);
+}
+
+// Free up to n idle pages, oldest first. Called by kalloc() when
+// it runs dry; returns the number of pages freed.
+int pcreclaim(int n) {
+    struct pcpage *pg, *prev;
+    int freed;
+
+    // An allocation made while the cache is locked (for a tree
+    // node, say) must fail rather than deadlock.
+    if(holding(&pcache.lock))
+        return 0;
+
+    freed = 0;
+    acquire(&pcache.lock);
+    for(pg = pcache.head.prev; pg != &pcache.head && freed < n; pg = prev) {
+        prev = pg->prev;
+        if(getReferenceCount(V2P(pg->data)) == 1) {
+            pcevict(pg);
+            freed++;
+        }
+    }
+    release(&pcache.lock);
+    return freed;
+}
@@ -19,6 +19,18 @@ struct pipe {
     int writeopen; // write fd is still open
 };
 
+static struct kmem_cache *pipecache;
+
+// Slab constructor: a pipe's lock survives being freed
+// and reallocated.
+static void pipector(void *v) {
+    initlock(&((struct pipe*)v)->lock, "pipe");
+}
+
+void pipeinit(void) {
+    pipecache = kmem_cache_create("pipe", sizeof(struct pipe), pipector);
+}
+
 int pipealloc(struct file **f0, struct file **f1) {
     struct pipe *p;
 
@@ -26,13 +38,12 @@ int pipealloc(struct file **f0, struct file **f1) {
     *f0 = *f1 = 0;
     if((*f0 = filealloc()) == 0 || (*f1 = filealloc()) == 0)
         goto bad;
-    if((p = (struct pipe*)kalloc()) == 0)
+    if((p = kmem_cache_alloc(pipecache)) == 0)
         goto bad;
     p->readopen = 1;
     p->writeopen = 1;
     p->nwrite = 0;
     p->nread = 0;
-    initlock(&p->lock, "pipe");
     (*f0)->type = FD_PIPE;
     (*f0)->readable = 1;
     (*f0)->writable = 0;
@@ -46,7 +57,7 @@ int pipealloc(struct file **f0, struct file **f1) {
 //PAGEBREAK: 20
 bad:
     if(p)
-        kfree((char*)p);
+        kmem_cache_free(pipecache, p);
     if(*f0)
         fileclose(*f0);
     if(*f1)
@@ -65,7 +76,7 @@ void pipeclose(struct pipe *p, int writable) {
     }
     if(p->readopen == 0 && p->writeopen == 0) {
         release(&p->lock);
-        kfree((char*)p);
+        kmem_cache_free(pipecache, p);
     } else
         release(&p->lock);
 }
@@ -2,8 +2,17 @@
 #include "stat.h"
 #include "user.h"
 
+// Output is collected here and written out a buffer at a time,
+// rather than with a write() for every character.
+static char obuf[128];
+static int on;
+
 static void putc(int fd, char c) {
-    write(fd, &c, 1);
+    if(on == sizeof(obuf)) {
+        write(fd, obuf, on);
+        on = 0;
+    }
+    obuf[on++] = c;
 }
 
 static void printint(int fd, int xx, int base, int sgn) {
@@ -76,4 +85,7 @@ void printf(int fd, const char *fmt, ...) {
             state = 0;
         }
     }
+    if(on > 0)
+        write(fd, obuf, on);
+    on = 0;
 }
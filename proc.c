@@ -8,35 +8,130 @@
 #include "rand.h"
 #include "proc.h"
 #include "pstat.h"
+#include "vdso.h"
 
 //changing to code found at https://github.com/GUG11/CS537-xv6
 
+// Processes are allocated from a slab cache, so the only limit
+// on their number is memory. ptable.lock protects the list of
+// all processes (which the scheduler walks), the PID hash used
+// by kill(), and each process's list of children, which lets
+// wait() and exit() look only at a process's own relatives.
+
+#define NPIDHASH 256
+
 struct {
     struct spinlock lock;
-    struct proc proc[NPROC];
-    // 3 queues
-    struct proc* que[3][NPROC];
-    //number of processes in each queue
-    int priCount[3];
+    struct kmem_cache *cache;
+    struct proc *head;         // all processes, oldest first
+    struct proc *tail;
+    int nproc;                 // length of that list
+    struct proc *pidhash[NPIDHASH];
+    int clockpid;              // process kswapd's clock hand is in
+    // MFQ run queues, one per priority, linked through qnext
+    struct proc *qhead[3];
+    struct proc *qtail[3];
 } ptable;
 
 static struct proc *initproc;
-struct pstat pstat_var;
+static void waitqinit(void);
 
 int nextpid = 1;
 extern void forkret(void);
 extern void trapret(void);
+static void kthreadret(void);
 
 
 void pinit(void) {
     initlock(&ptable.lock, "ptable");
+    waitqinit();
+    ptable.cache = kmem_cache_create("proc", sizeof(struct proc), 0);
     // Seed random with current time
     struct rtcdate *r;
     sgenrand((unsigned long)&r);
-    // init queues
-    ptable.priCount[0] = -1;
-    ptable.priCount[1] = -1;
-    ptable.priCount[2] = -1;
+}
+
+#ifdef MFQ
+// Append p to the run queue for priority pri.
+// Caller holds ptable.lock.
+static void qpush(int pri, struct proc *p) {
+    p->qnext = 0;
+    if(ptable.qtail[pri])
+        ptable.qtail[pri]->qnext = p;
+    else
+        ptable.qhead[pri] = p;
+    ptable.qtail[pri] = p;
+}
+
+// Take the first process off the run queue for priority pri,
+// or return 0 if it is empty. Caller holds ptable.lock.
+static struct proc* qpop(int pri) {
+    struct proc *p;
+
+    if((p = ptable.qhead[pri]) == 0)
+        return 0;
+    if((ptable.qhead[pri] = p->qnext) == 0)
+        ptable.qtail[pri] = 0;
+    p->qnext = 0;
+    return p;
+}
+
+// Take p off the run queue for priority pri, if it is there.
+// Caller holds ptable.lock.
+static void qremove(int pri, struct proc *p) {
+    struct proc **pp, *prev;
+
+    prev = 0;
+    for(pp = &ptable.qhead[pri]; *pp; pp = &(*pp)->qnext) {
+        if(*pp == p) {
+            *pp = p->qnext;
+            if(ptable.qtail[pri] == p)
+                ptable.qtail[pri] = prev;
+            p->qnext = 0;
+            return;
+        }
+        prev = *pp;
+    }
+}
+#endif
+
+// The kernel data page's copy of getpinfo() (vdso.h) follows
+// the process table. Each of the NPROC oldest processes knows
+// its entry, p->pslot, and rewrites it when its state changes;
+// a process coming or going moves the others along, so
+// pinfosync() redoes them all. Caller holds ptable.lock.
+
+static void pinfofill(struct pstat *ps, int i, struct proc *p) {
+    ps->inuse[i] = (p->state != UNUSED);
+    ps->pid[i] = p->pid;
+    ps->priority[i] = p->priority;
+    ps->state[i] = p->state;
+}
+
+static void pinfosync(void) {
+    struct proc *p;
+    int i;
+
+    vdata->pseq++;
+    __sync_synchronize();
+    memset(&vdata->pinfo, 0, sizeof(vdata->pinfo));
+    for(i = 0, p = ptable.head; i < NPROC && p; i++, p = p->next) {
+        p->pslot = i;
+        pinfofill(&vdata->pinfo, i, p);
+    }
+    __sync_synchronize();
+    vdata->pseq++;
+}
+
+static void setstate(struct proc *p, enum procstate state) {
+    p->state = state;
+    if(p->pslot < 0)
+        return;
+    vdata->pseq++;
+    __sync_synchronize();
+    pinfofill(&vdata->pinfo, p->pslot, p);
+    __sync_synchronize();
+    vdata->pseq++;
 }
 
 // Must be called with interrupts disabled
@@ -74,57 +169,100 @@ struct proc* myproc(void) {
     return p;
 }
 
+// Find the process with the given pid. Caller holds ptable.lock.
+static struct proc* findproc(int pid) {
+    struct proc *p;
+
+    for(p = ptable.pidhash[pid % NPIDHASH]; p; p = p->hnext)
+        if(p->pid == pid)
+            return p;
+    return 0;
+}
+
+// Make p a child of parent. Caller holds ptable.lock.
+static void addchild(struct proc *parent, struct proc *p) {
+    p->parent = parent;
+    p->sibprev = 0;
+    p->sibnext = parent->children;
+    if(parent->children)
+        parent->children->sibprev = p;
+    parent->children = p;
+}
+
+// Take p off every list and free it along with its kernel
+// stack and address space. Caller holds ptable.lock.
+static void freeproc(struct proc *p) {
+    struct proc **pp;
+
+    if(p->parent) {
+        if(p->sibprev)
+            p->sibprev->sibnext = p->sibnext;
+        else
+            p->parent->children = p->sibnext;
+        if(p->sibnext)
+            p->sibnext->sibprev = p->sibprev;
+    }
+
+    for(pp = &ptable.pidhash[p->pid % NPIDHASH]; *pp != p; pp = &(*pp)->hnext)
+        ;
+    *pp = p->hnext;
+
+    if(p->prev)
+        p->prev->next = p->next;
+    else
+        ptable.head = p->next;
+    if(p->next)
+        p->next->prev = p->prev;
+    else
+        ptable.tail = p->prev;
+    ptable.nproc--;
+    if(p->pslot >= 0)
+        pinfosync();
+
+    if(p->kstack)
+        kfree(p->kstack);
+    if(p->pgdir)
+        freevm(p->pgdir);
+    p->state = UNUSED;
+    kmem_cache_free(ptable.cache, p);
+}
+
 //PAGEBREAK: 32
-// Look in the process table for an UNUSED proc.
-// If found, change state to EMBRYO and initialize
+// Allocate a new proc from the process cache.
+// If successful, its state is EMBRYO and it has the
 // state required to run in the kernel.
 // Otherwise return 0.
 static struct proc* allocproc(void) {
     struct proc *p;
     char *sp;
 
-    acquire(&ptable.lock);
-
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-        if(p->state == UNUSED)
-            goto found;
-
-    pstat_var.inuse[p->pid] = 1;
-    pstat_var.priority[p->pid] = p->priority;
-    pstat_var.ticks[p->pid][0] = 0;
-    pstat_var.ticks[p->pid][1] = 0;
-    pstat_var.ticks[p->pid][2] = 0;
-    pstat_var.ticks[p->pid][3] = 0;
-    pstat_var.pid[p->pid] = p->pid;
+    if((p = kmem_cache_alloc(ptable.cache)) == 0)
+        return 0;
+    memset(p, 0, sizeof(*p));
 
-    release(&ptable.lock);
-    return 0;
+    // Allocate kernel stack.
+    if((p->kstack = kalloc()) == 0) {
+        kmem_cache_free(ptable.cache, p);
+        return 0;
+    }
 
-found:
-    p->state = EMBRYO;
+    acquire(&ptable.lock);
     p->pid = nextpid++;
-
-    pstat_var.inuse[p->pid] = 1;
-    pstat_var.priority[p->pid] = p->priority;
-    pstat_var.ticks[p->pid][0] = 0;
-    pstat_var.ticks[p->pid][1] = 0;
-    pstat_var.ticks[p->pid][2] = 0;
-    pstat_var.ticks[p->pid][3] = 0;
-    pstat_var.pid[p->pid] = p->pid;
-
-    p->priority = 0;
     p->ctime = ticks;
-    p->retime = 0;
-    p->rutime = 0;
-    p->stime = 0;
 
+    p->hnext = ptable.pidhash[p->pid % NPIDHASH];
+    ptable.pidhash[p->pid % NPIDHASH] = p;
+    p->prev = ptable.tail;
+    if(ptable.tail)
+        ptable.tail->next = p;
+    else
+        ptable.head = p;
+    ptable.tail = p;
+    p->pslot = ptable.nproc < NPROC ? ptable.nproc : -1;
+    ptable.nproc++;
+    setstate(p, EMBRYO);
     release(&ptable.lock);
 
-    // Allocate kernel stack.
-    if((p->kstack = kalloc()) == 0) {
-        p->state = UNUSED;
-        return 0;
-    }
     sp = p->kstack + KSTACKSIZE;
 
     // Leave room for trap frame.
@@ -179,25 +317,52 @@ void userinit(void) {
     // because the assignment might not be atomic.
 #ifdef DEFAULT
     acquire(&ptable.lock);
-    p->state = RUNNABLE;
+    setstate(p, RUNNABLE);
     release(&ptable.lock);
 #else
 #ifdef LOTTERY
     acquire(&ptable.lock);
-    p->state = RUNNABLE;
+    setstate(p, RUNNABLE);
     release(&ptable.lock);
 #else
 #ifdef MFQ
-    ptable.priCount[0]++;
-    ptable.que[0][ptable.priCount[0]] = p;
-    p->state = RUNNABLE;
+    qpush(0, p);
+    setstate(p, RUNNABLE);
 #endif
 #endif
 #endif
 
 }
 
+// Start a kernel thread running fn, which must never return.
+// It has no user memory, and instead of forkret and trapret its
+// kernel stack returns through kthreadret into fn.
+void kthread(char *name, void (*fn)(void)) {
+    struct proc *p;
+
+    if((p = allocproc()) == 0 || (p->pgdir = setupkvm()) == 0)
+        panic("kthread");
+    *(uint*)((char*)p->context + sizeof(*p->context)) = (uint)fn;
+    p->context->eip = (uint)kthreadret;
+    p->tickets = DEFAULT_TICKETS; // used in RANDOM
+    safestrcpy(p->name, name, sizeof(p->name));
+
+    acquire(&ptable.lock);
+#ifdef MFQ
+    qpush(0, p);
+#endif
+    setstate(p, RUNNABLE);
+    release(&ptable.lock);
+}
+
+static void kthreadret(void) {
+    // Still holding ptable.lock from scheduler.
+    release(&ptable.lock);
+}
+
 // Grow current process's memory by n bytes.
+// New memory is not allocated until it is touched
+// (see vmafill in vm.c); memory given back is freed now.
 // Return 0 on success, -1 on failure.
 int growproc(int n) {
     uint sz;
@@ -205,14 +370,21 @@ int growproc(int n) {
 
     sz = curproc->sz;
     if(n > 0) {
-        if((sz = allocuvm(curproc->pgdir, sz, sz + n)) == 0)
+        if(sz + n < sz || sz + n >= MMAPBASE)
             return -1;
+        if(vmagrow(curproc, sz + n) < 0)
+            return -1;
+        sz += n;
     } else if(n < 0) {
-        if((sz = deallocuvm(curproc->pgdir, sz, sz + n)) == 0)
+        if(sz + n > sz)
+            return -1;
+        if(uvmunshare(curproc, PGROUNDUP(sz + n), sz) < 0)
             return -1;
+        sz = deallocuvm(curproc->pgdir, sz, sz + n);
+        vmashrink(curproc, sz);
+        tlbflush(curproc->pgdir);
     }
     curproc->sz = sz;
-    switchuvm(curproc);
     return 0;
 }
 
@@ -227,14 +399,14 @@ int fork_original(void) {
     }
 
     // Copy process state from proc.
-    if((np->pgdir = copyuvm_original(curproc->pgdir, curproc->sz)) == 0) {
-        kfree(np->kstack);
-        np->kstack = 0;
-        np->state = UNUSED;
+    if((np->pgdir = copyuvm_original(curproc->pgdir, curproc->sz)) == 0 ||
+       copymmap(np->pgdir, curproc) < 0) {
+        acquire(&ptable.lock);
+        freeproc(np);
+        release(&ptable.lock);
         return -1;
     }
     np->sz = curproc->sz;
-    np->parent = curproc;
     *np->tf = *curproc->tf;
     np->tickets = DEFAULT_TICKETS; // used in RANDOM
 
@@ -247,17 +419,19 @@ int fork_original(void) {
             np->ofile[i] = filedup(curproc->ofile[i]);
 
     np->cwd = idup(curproc->cwd);
+    vmadup(np->vma, curproc->vma);
+    np->ring = curproc->ring;
 
     safestrcpy(np->name, curproc->name, sizeof(curproc->name));
 
     pid = np->pid;
 
     acquire(&ptable.lock);
+    addchild(curproc, np);
 #ifdef MFQ
-    ptable.priCount[0]++;
-    ptable.que[0][ptable.priCount[0]] = np;
+    qpush(0, np);
 #endif
-    np->state = RUNNABLE;
+    setstate(np, RUNNABLE);
     release(&ptable.lock);
 
     return pid;
@@ -277,15 +451,14 @@ int fork(void) {
     }
 
     // Copy process state from proc.
-    if((np->pgdir = copyuvm(curproc->pgdir, curproc->sz)) == 0) {
-        kfree(np->kstack);
-        np->kstack = 0;
-        np->state = UNUSED;
+    if((np->pgdir = copyuvm(curproc)) == 0) {
+        acquire(&ptable.lock);
+        freeproc(np);
+        release(&ptable.lock);
         return -1;
     }
 
     np->sz = curproc->sz;
-    np->parent = curproc;
     *np->tf = *curproc->tf;
     np->tickets = DEFAULT_TICKETS; // used in RANDOM
 
@@ -297,17 +470,19 @@ int fork(void) {
             np->ofile[i] = filedup(curproc->ofile[i]);
 
     np->cwd = idup(curproc->cwd);
+    vmadup(np->vma, curproc->vma);
+    np->ring = curproc->ring;
 
     safestrcpy(np->name, curproc->name, sizeof(curproc->name));
 
     pid = np->pid;
 
     acquire(&ptable.lock);
+    addchild(curproc, np);
 #ifdef MFQ
-    ptable.priCount[0]++;
-    ptable.que[0][ptable.priCount[0]] = np;
+    qpush(0, np);
 #endif
-    np->state = RUNNABLE;
+    setstate(np, RUNNABLE);
     release(&ptable.lock);
 
     return pid;
@@ -329,41 +504,37 @@ int pdump(void) {
 
     acquire(&ptable.lock);
 
-    // Pass abandoned children to init.
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++) {
-        if (p->state != NULL) {
-
-            if(p->state >= 0 && p->state < NELEM(states) && states[p->state])
-                state = states[p->state];
-            else
-                state = "???";
-
-            cprintf("[ %s ]\n", p->name);
-            cprintf("    -> State:     %s\n", state);
-            cprintf("    -> PID:       %d\n", p->pid);
-            cprintf("    -> Parent:    ");
-            if (p->parent != 0) {
-                parent = p->parent;
-                while (parent != 0) {
-                    cprintf("[ %s ]", parent->name);
-                    parent = parent->parent;
-                    if (parent != 0) {
-                        cprintf("->");
-                    }
+    for(p = ptable.head; p; p = p->next) {
+        if(p->state >= 0 && p->state < NELEM(states) && states[p->state])
+            state = states[p->state];
+        else
+            state = "???";
+
+        cprintf("[ %s ]\n", p->name);
+        cprintf("    -> State:     %s\n", state);
+        cprintf("    -> PID:       %d\n", p->pid);
+        cprintf("    -> Parent:    ");
+        if (p->parent != 0) {
+            parent = p->parent;
+            while (parent != 0) {
+                cprintf("[ %s ]", parent->name);
+                parent = parent->parent;
+                if (parent != 0) {
+                    cprintf("->");
                 }
-            } else {
-                cprintf("In the beginning there was init and none were before him.");
             }
-            cprintf("\n");
-
-            cprintf("    -> Killed:    %d\n", p->killed);
-            cprintf("    -> Priority:  %d\n", p->priority);
-            cprintf("    -> Ctime:     %d\n", p->ctime);
-            cprintf("    -> Stime:     %d\n", p->stime);
-            cprintf("    -> Rutime:    %d\n", p->retime);
-            cprintf("    -> Retime:    %d\n", p->rutime);
-            cprintf("-------------------------------------------\n");
+        } else {
+            cprintf("In the beginning there was init and none were before him.");
         }
+        cprintf("\n");
+
+        cprintf("    -> Killed:    %d\n", p->killed);
+        cprintf("    -> Priority:  %d\n", p->priority);
+        cprintf("    -> Ctime:     %d\n", p->ctime);
+        cprintf("    -> Stime:     %d\n", p->stime);
+        cprintf("    -> Rutime:    %d\n", p->retime);
+        cprintf("    -> Retime:    %d\n", p->rutime);
+        cprintf("-------------------------------------------\n");
     }
 
     release(&ptable.lock);
@@ -390,8 +561,10 @@ void exit(void) {
         }
     }
 
+    vmasync(curproc);
     begin_op();
     iput(curproc->cwd);
+    vmaclear(curproc->vma);
     end_op();
     curproc->cwd = 0;
 
@@ -401,16 +574,17 @@ void exit(void) {
     wakeup1(curproc->parent);
 
     // Pass abandoned children to init.
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++) {
-        if(p->parent == curproc) {
-            p->parent = initproc;
-            if(p->state == ZOMBIE)
-                wakeup1(initproc);
-        }
+    while((p = curproc->children) != 0) {
+        curproc->children = p->sibnext;
+        if(p->sibnext)
+            p->sibnext->sibprev = 0;
+        addchild(initproc, p);
+        if(p->state == ZOMBIE)
+            wakeup1(initproc);
     }
 
     // Jump into the scheduler, never to return.
-    curproc->state = ZOMBIE;
+    setstate(curproc, ZOMBIE);
     sched();
     panic("zombie exit");
 }
@@ -425,22 +599,12 @@ int wait(void) {
     acquire(&ptable.lock);
     for(;;) {
         // Scan through table looking for exited children.
-        havekids = 0;
-        for(p = ptable.proc; p < &ptable.proc[NPROC]; p++) {
-            if(p->parent != curproc)
-                continue;
-            havekids = 1;
+        havekids = curproc->children != 0;
+        for(p = curproc->children; p; p = p->sibnext) {
             if(p->state == ZOMBIE) {
                 // Found one.
                 pid = p->pid;
-                kfree(p->kstack);
-                p->kstack = 0;
-                freevm(p->pgdir);
-                p->pid = 0;
-                p->parent = 0;
-                p->name[0] = 0;
-                p->killed = 0;
-                p->state = UNUSED;
+                freeproc(p);
                 release(&ptable.lock);
                 return pid;
             }
@@ -464,30 +628,15 @@ int testwait(int *retime, int *rutime, int *stime) {
     acquire(&ptable.lock);
     for(;;) {
         // Scan through table looking for zombie children.
-        havekids = 0;
-        for(p = ptable.proc; p < &ptable.proc[NPROC]; p++) {
-            if(p->parent != myproc())
-                continue;
-            havekids = 1;
+        havekids = myproc()->children != 0;
+        for(p = myproc()->children; p; p = p->sibnext) {
             if(p->state == ZOMBIE) {
                 // Found one.
                 *retime = p->retime;
                 *rutime = p->rutime;
                 *stime = p->stime;
                 pid = p->pid;
-                kfree(p->kstack);
-                p->kstack = 0;
-                freevm(p->pgdir);
-                p->state = UNUSED;
-                p->pid = 0;
-                p->parent = 0;
-                p->name[0] = 0;
-                p->killed = 0;
-                p->ctime = 0;
-                p->retime = 0;
-                p->rutime = 0;
-                p->stime = 0;
-                p->priority = 0;
+                freeproc(p);
                 release(&ptable.lock);
                 return pid;
             }
@@ -524,7 +673,7 @@ void scheduler(void) {
 
         // Loop over process table looking for process to run.
         acquire(&ptable.lock);
-        for(p = ptable.proc; p < &ptable.proc[NPROC]; p++) {
+        for(p = ptable.head; p; p = p->next) {
 
             if(p->state != RUNNABLE)
                 continue;
@@ -535,7 +684,7 @@ void scheduler(void) {
                 // before jumping back to us.
                 c->proc = p;
                 switchuvm(p);
-                p->state = RUNNING;
+                setstate(p, RUNNING);
 
                 swtch(&(c->scheduler), p->context);
                 switchkvm();
@@ -561,7 +710,7 @@ void scheduler(void) {
 
         // Loop over process table looking for process to run.
         acquire(&ptable.lock);
-        for(p = ptable.proc; p < &ptable.proc[NPROC]; p++) {
+        for(p = ptable.head; p; p = p->next) {
 
             if(p->state != RUNNABLE)
                 continue;
@@ -580,7 +729,7 @@ void scheduler(void) {
                 // before jumping back to us.
                 c->proc = p;
                 switchuvm(p);
-                p->state = RUNNING;
+                setstate(p, RUNNING);
 
                 swtch(&(c->scheduler), p->context);
                 switchkvm();
@@ -604,19 +753,15 @@ void scheduler(void) {
         acquire(&ptable.lock);
         int priority;
         for(priority = 0; priority <= PRIORITY_MAX; priority++) {
-            while(ptable.priCount[priority] > -1) {
-                struct proc *proc = ptable.que[priority][0];
-                int i;
-                for (i = 0; i < ptable.priCount[priority]; i++) {
-                    ptable.que[priority][i] = ptable.que[priority][i + 1];
-                }
-                ptable.priCount[priority]--;
+            struct proc *proc;
+            while((proc = qpop(priority)) != 0) {
+                mycpu()->proc = proc;
                 switchuvm(proc);
-                proc->state = RUNNING;
+                setstate(proc, RUNNING);
                 swtch(&mycpu()->scheduler, proc->context);
                 switchkvm();
 
-                proc = 0;
+                mycpu()->proc = 0;
                 priority = 0;
             }
         }
@@ -656,13 +801,13 @@ void yield(void) {
 
     acquire(&ptable.lock); //DOC: yieldlock
 #ifdef MFQ
+    struct proc *proc = myproc();
     if (proc->priority < 2) {
         proc->priority++;
     }
-    ptable.priCount[proc->priority]++;
-    ptable.que[proc->priority][ptable.priCount[proc->priority]] = proc;
+    qpush(proc->priority, proc);
 #endif
-    myproc()->state = RUNNABLE;
+    setstate(myproc(), RUNNABLE);
     sched();
     release(&ptable.lock);
 }
@@ -681,15 +826,54 @@ void forkret(void) {
         first = 0;
         iinit(ROOTDEV);
         initlog(ROOTDEV);
+        swapinit(ROOTDEV);
     }
 
     // Return to "caller", actually trapret (see allocproc).
 }
 
+// Sleeping processes wait on queues hashed by channel, so that
+// wakeup() only looks at processes sleeping on (a channel that
+// hashes like) its own, and a wakeup with no waiters never
+// touches ptable.lock.
+//
+// A bucket's lock protects its queue and p->onwaitq. Lock order
+// is a sleeper's lk, then ptable.lock, then a bucket lock; nobody
+// acquires ptable.lock while holding a bucket lock.
+
+#define NWAITQ 64
+#define WAITQ(chan) (&waitq[((uint)(chan) >> 2) % NWAITQ])
+
+struct waitq {
+    struct spinlock lock;
+    struct proc *head;
+};
+
+static struct waitq waitq[NWAITQ];
+
+static void waitqinit(void) {
+    int i;
+
+    for(i = 0; i < NWAITQ; i++)
+        initlock(&waitq[i].lock, "waitq");
+}
+
+// Caller holds q->lock.
+static void waitq_remove(struct waitq *q, struct proc *p) {
+    if(p->wqprev)
+        p->wqprev->wqnext = p->wqnext;
+    else
+        q->head = p->wqnext;
+    if(p->wqnext)
+        p->wqnext->wqprev = p->wqprev;
+    p->onwaitq = 0;
+}
+
 // Atomically release lock and sleep on chan.
 // Reacquires lock when awakened.
 void sleep(void *chan, struct spinlock *lk) {
     struct proc *p = myproc();
+    struct waitq *q = WAITQ(chan);
 
     if(p == 0)
         panic("sleep");
@@ -697,23 +881,39 @@ void sleep(void *chan, struct spinlock *lk) {
     if(lk == 0)
         panic("sleep without lk");
 
+    // Join chan's wait queue while still holding lk. A wakeup
+    // that comes after we release lk is bound to find us there.
+    acquire(&q->lock);
+    p->chan = chan;
+    p->wqprev = 0;
+    p->wqnext = q->head;
+    if(q->head)
+        q->head->wqprev = p;
+    q->head = p;
+    p->onwaitq = 1;
+    release(&q->lock);
+
     // Must acquire ptable.lock in order to
     // change p->state and then call sched.
-    // Once we hold ptable.lock, we can be
-    // guaranteed that we won't miss any wakeup
-    // (wakeup runs with ptable.lock locked),
-    // so it's okay to release lk.
+    // A wakeup that runs before we are SLEEPING takes
+    // us off the queue, so we check for that under
+    // ptable.lock rather than sleep through it.
     if(lk != &ptable.lock) { //DOC: sleeplock0
         acquire(&ptable.lock); //DOC: sleeplock1
         release(lk);
     }
     // Go to sleep.
-    p->chan = chan;
-    p->state = SLEEPING;
-
-    sched();
+    if(p->onwaitq) {
+        setstate(p, SLEEPING);
+        sched();
+    }
 
-    // Tidy up.
+    // Tidy up. kill() wakes us without dequeuing.
+    if(p->onwaitq) {
+        acquire(&q->lock);
+        waitq_remove(q, p);
+        release(&q->lock);
+    }
     p->chan = 0;
 
     // Reacquire original lock.
@@ -727,19 +927,39 @@ void sleep(void *chan, struct spinlock *lk) {
 // Wake up all processes sleeping on chan.
 // The ptable lock must be held.
 void wakeup1(void *chan) {
-    struct proc *p;
+    struct waitq *q = WAITQ(chan);
+    struct proc *p, *next;
 
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-        if(p->state == SLEEPING && p->chan == chan)
+    acquire(&q->lock);
+    for(p = q->head; p; p = next) {
+        next = p->wqnext;
+        if(p->chan != chan)
+            continue;
+        waitq_remove(q, p);
+        if(p->state == SLEEPING) {
 #ifdef MFQ
-            ptable.priCount[p->priority]++;
-    ptable.que[p->priority][ptable.priCount[p->priority]] = p;
+            qpush(p->priority, p);
 #endif
-            p->state = RUNNABLE;
+            setstate(p, RUNNABLE);
+        }
+    }
+    release(&q->lock);
 }
 
 // Wake up all processes sleeping on chan.
 void wakeup(void *chan) {
+    struct waitq *q = WAITQ(chan);
+    struct proc *p;
+
+    // Nobody waiting: don't bother with ptable.lock.
+    acquire(&q->lock);
+    for(p = q->head; p; p = p->wqnext)
+        if(p->chan == chan)
+            break;
+    release(&q->lock);
+    if(p == 0)
+        return;
+
     acquire(&ptable.lock);
     wakeup1(chan);
     release(&ptable.lock);
@@ -752,19 +972,17 @@ int kill(int pid) {
     struct proc *p;
 
     acquire(&ptable.lock);
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++) {
-        if(p->pid == pid) {
-            p->killed = 1;
-            // Wake process from sleep if necessary.
-            if(p->state == SLEEPING)
+    if((p = findproc(pid)) != 0) {
+        p->killed = 1;
+        // Wake process from sleep if necessary.
+        if(p->state == SLEEPING) {
 #ifdef MFQ
-                ptable.priCount[p->priority]++;
-            ptable.que[p->priority][ptable.priCount[p->priority]] = p;
+            qpush(p->priority, p);
 #endif
-                p->state = RUNNABLE;
-            release(&ptable.lock);
-            return 0;
+            setstate(p, RUNNABLE);
         }
+        release(&ptable.lock);
+        return 0;
     }
     release(&ptable.lock);
     return -1;
@@ -788,9 +1006,7 @@ void procdump(void) {
     char *state;
     uint pc[10];
 
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++) {
-        if(p->state == UNUSED)
-            continue;
+    for(p = ptable.head; p; p = p->next) {
         if(p->state >= 0 && p->state < NELEM(states) && states[p->state])
             state = states[p->state];
         else
@@ -811,7 +1027,7 @@ int totalTickets(void) {
 
     struct proc *p;
     int total = 0;
-    for (p = ptable.proc; p < &ptable.proc[NPROC]; p++) {
+    for (p = ptable.head; p; p = p->next) {
         if (p->state == RUNNABLE) {
             total += p->tickets;
         }
@@ -823,36 +1039,28 @@ int totalTickets(void) {
 void resetPriority(void) {
     struct proc *p;
     acquire(&ptable.lock);
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++) {
+    for(p = ptable.head; p; p = p->next) {
+#ifdef MFQ
         if (p->state == RUNNABLE) {
             //delete the runnable process from its original queue
-            int token;
-            for (token = 0; token < NPROC; token++) {
-                if (p == ptable.que[p->priority][token]) {
-                    int i;
-                    for (i = token; i < ptable.priCount[p->priority]; i++) {
-                        ptable.que[p->priority][i] = ptable.que[p->priority][i + 1];
-                    }
-                    ptable.priCount[p->priority]--;
-                }
-                break;
-            }
+            qremove(p->priority, p);
             //set the priority to 0, and add it to the first queue
             p->priority = 0;
-            ptable.priCount[0]++;
-            ptable.que[0][ptable.priCount[0]] = p;
-        } else {
-            //queues only contain process that are runnable, so change the priority is enough.
-            p->priority = 0;
+            qpush(0, p);
+            continue;
         }
+#endif
+        //queues only contain process that are runnable, so change the priority is enough.
+        p->priority = 0;
     }
+    pinfosync();
     release(&ptable.lock);
 }
 
 void updateStats() {
     struct proc *p;
     acquire(&ptable.lock);
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++) {
+    for(p = ptable.head; p; p = p->next) {
         switch(p->state) {
         case SLEEPING:
             p->stime++;
@@ -874,12 +1082,11 @@ void getpinfo(struct pstat* ps) {
     int i = 0;
     int pi = 0;
     struct proc* pptr;
-    for (i = 0; i < NPROC; i++) {
-        pptr = &ptable.proc[i];
-        ps->inuse[i] = (pptr->state != UNUSED);
-        ps->pid[i] = pptr->pid;
-        ps->priority[i] = pptr->priority;
-        ps->state[i] = pptr->state;
+    // Report the NPROC oldest processes.
+    memset(ps, 0, sizeof(*ps));
+    acquire(&ptable.lock);
+    for (i = 0, pptr = ptable.head; i < NPROC && pptr; i++, pptr = pptr->next) {
+        pinfofill(ps, i, pptr);
 //        for (pi = 0; pi < pptr->priority; pi++) {
 //            ps->ticks[i][pi] = tick_quota[pi];
 //        }
@@ -888,4 +1095,36 @@ void getpinfo(struct pstat* ps) {
 //            ps->ticks[i][pi] = 0;
 //        }
     }
+    release(&ptable.lock);
+}
+
+// Choose a page for kswapd to swap out to slot s, sweeping the
+// clock hand over the processes in turn (see clockscan in vm.c).
+// Only processes stopped with p->swappable set are looked at;
+// the kernel may be using the memory of any other. Returns the
+// page, no longer mapped, or 0 if there is none.
+char* swapvictim(uint s) {
+    struct proc *p;
+    char *mem;
+    int i, n;
+
+    acquire(&ptable.lock);
+    n = 0;
+    for(p = ptable.head; p; p = p->next)
+        n++;
+    if((p = findproc(ptable.clockpid)) == 0)
+        p = ptable.head;
+
+    // Twice round, since the first pass may only clear PTE_A.
+    mem = 0;
+    for(i = 0; p && i <= 2*n; i++) {
+        if(p->swappable && (p->state == RUNNABLE || p->state == SLEEPING) &&
+           (mem = clockscan(p, s)) != 0)
+            break;
+        p = p->next ? p->next : ptable.head;
+    }
+    if(p)
+        ptable.clockpid = p->pid;
+    release(&ptable.lock);
+    return mem;
 }
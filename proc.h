@@ -1,4 +1,5 @@
 #include "pstat.h"
+#include "timer.h"
 
 #define DEFAULT_TICKETS 1
 // 3 queues
@@ -18,6 +19,16 @@ struct cpu {
     // Cpu-local storage variables; see below
     struct cpu *cpu;           // Currently running CPU
     struct proc *proc;         // The currently-running process.
+
+    // TLB shootdown; see tlbinval in vm.c
+    pde_t *pgdir;              // Page table loaded in %cr3
+    volatile uint tlbbusy;     // Mailbox taken by a sender
+    volatile uint tlbva;       // Page to invalidate, or TLBALL
+    volatile int tlbpending;   // Request not yet carried out
+
+    // LAPIC timer; see lapicarm in lapic.c
+    int oneshot;               // Timer not in periodic mode
+    uint tickleft;             // Counts from early interrupt to tick
 };
 
 extern struct cpu cpus[NCPU];
@@ -45,6 +56,21 @@ struct context {
 
 //enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
+// A range of user memory whose pages are filled in on first
+// touch (see vmafill in vm.c): filesz bytes from ip at offset
+// off, then zeroes. A slot with end == 0 is unused.
+// Regions created by mmap() have a non-zero flags and lie
+// above MMAPBASE; the others make up p->sz.
+struct vma {
+    uint start;                // page aligned
+    uint end;
+    struct inode *ip;          // 0 for zero-filled memory
+    uint off;
+    uint filesz;
+    int prot;                  // PROT_ bits, for mmap() regions
+    int flags;                 // MAP_ bits, for mmap() regions
+};
+
 
 // Per-process state
 struct proc {
@@ -60,6 +86,8 @@ struct proc {
     int killed;                // If non-zero, have been killed
     struct file *ofile[NOFILE]; // Open files
     struct inode *cwd;         // Current directory
+    struct vma vma[NVMA];      // Demand-paged regions
+    struct ring *ring;         // Submission ring, in user memory
     char name[16];             // Process name (debugging)
     int stime;                  //
     uint ctime;                  // creation time
@@ -68,6 +96,27 @@ struct proc {
     int tickets;               // Number of tickets for random scheduler
     int priority;              // added for MLFQ
     int ticks;
+
+    // protected by ptable.lock
+    struct proc *next;         // all processes, in creation order
+    struct proc *prev;
+    struct proc *hnext;        // PID hash chain
+    struct proc *qnext;        // MFQ run queue
+    int pslot;                 // entry in the vdso.h pinfo, or -1
+    struct proc *children;     // first child
+    struct proc *sibnext;      // parent's other children
+    struct proc *sibprev;
+    int swappable;             // stopped with no kernel pointers into
+                               // our memory; kswapd may take pages
+    uint clockva;              // kswapd's clock hand; see clockscan
+
+    // protected by the lock of chan's wait queue
+    struct proc *wqnext;       // other sleepers in the queue
+    struct proc *wqprev;
+    int onwaitq;               // queued on chan's wait queue
+
+    struct timer timer;        // sleep() deadline; see sys_sleep
+    struct hrtimer hrtimer;    // nanosleep() deadline
 };
 
 
@@ -0,0 +1,69 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+// File read benchmark. Writes a file several times the size of
+// the buffer cache, then reads it back N times. With file data
+// in the page cache, only the first pass should touch the disk.
+
+#define N       20
+#define FSIZE   (64*1024)
+
+char buf[512];
+
+static int readall(char *name) {
+    int fd, n, i, total;
+
+    if((fd = open(name, O_RDONLY)) < 0)
+        return -1;
+    total = 0;
+    while((n = read(fd, buf, sizeof(buf))) > 0) {
+        for(i = 0; i < n; i++) {
+            if(buf[i] != (char)(total + i)) {
+                close(fd);
+                return -1;
+            }
+        }
+        total += n;
+    }
+    close(fd);
+    return total;
+}
+
+int main(int argc, char *argv[]) {
+    int fd, i, j, t0;
+
+    if((fd = open("readbench.tmp", O_CREATE | O_RDWR)) < 0) {
+        printf(1, "readbench: create failed\n");
+        exit();
+    }
+    for(i = 0; i < FSIZE; i += sizeof(buf)) {
+        for(j = 0; j < sizeof(buf); j++)
+            buf[j] = i + j;
+        if(write(fd, buf, sizeof(buf)) != sizeof(buf)) {
+            printf(1, "readbench: write failed\n");
+            exit();
+        }
+    }
+    close(fd);
+
+    t0 = uptime();
+    if(readall("readbench.tmp") != FSIZE) {
+        printf(1, "readbench: bad data\n");
+        exit();
+    }
+    printf(1, "first read: %d ticks\n", uptime() - t0);
+
+    t0 = uptime();
+    for(i = 0; i < N; i++) {
+        if(readall("readbench.tmp") != FSIZE) {
+            printf(1, "readbench: bad data\n");
+            exit();
+        }
+    }
+    printf(1, "%d more reads: %d ticks\n", N, uptime() - t0);
+
+    unlink("readbench.tmp");
+    exit();
+}
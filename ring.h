@@ -0,0 +1,39 @@
+// Submission and completion rings, shared between a process and
+// the kernel (see ringenter in sysfile.c).
+//
+// The process fills in sq[sqtail % NRING] and advances sqtail,
+// once for each request, then calls ringenter(). The kernel
+// carries out requests from sqhead on, advancing sqhead, and
+// posts one cq entry for each at cqtail. The process takes them
+// from cqhead. The counters only ever grow.
+
+#define NRING        128  // entries in each ring; a power of two
+
+#define RING_READ      1  // read(fd, addr, n)
+#define RING_WRITE     2  // write(fd, addr, n)
+#define RING_OPEN      3  // open(addr, n)
+#define RING_CLOSE     4  // close(fd)
+#define RING_FSTAT     5  // fstat(fd, addr)
+#define RING_PIPE      6  // pipe(addr)
+
+struct sqe {
+    int op;         // RING_ value
+    int fd;
+    uint addr;      // buffer, path, struct stat or int[2]
+    int n;          // byte count, or open mode
+    uint data;      // handed back in the cqe
+};
+
+struct cqe {
+    uint data;      // from the sqe
+    int res;        // what the system call would have returned
+};
+
+struct ring {
+    uint sqhead;    // advanced by the kernel
+    uint sqtail;    // advanced by the process
+    uint cqhead;    // advanced by the process
+    uint cqtail;    // advanced by the kernel
+    struct sqe sq[NRING];
+    struct cqe cq[NRING];
+};
@@ -0,0 +1,233 @@
+// Slab allocator for small kernel objects.
+//
+// kalloc() hands out whole 4096-byte pages, which is far too
+// coarse for pipes, open files and in-memory inodes. A kmem_cache
+// carves pages ("slabs") into equal-sized objects:
+//
+//   + Each slab page starts with a struct slab header, followed by
+//     its objects. The slab of an object is found by rounding the
+//     object's address down to a page boundary.
+//   + The constructor runs once, when a slab is created. Objects
+//     must be handed back to kmem_cache_free() in their constructed
+//     state (e.g. with their locks initialized and released), so
+//     that reallocation skips the constructor.
+//   + Each CPU keeps a small magazine of free objects, so that most
+//     allocations and frees touch neither the cache lock nor the
+//     slab lists.
+//   + A slab that becomes entirely free is returned to kalloc()
+//     unless it is the only slab the cache has left with room.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "spinlock.h"
+
+#define NSLABCACHE  16   // maximum number of caches
+#define MAGSIZE      8   // objects per per-CPU magazine
+
+struct magazine {
+    int n;
+    void *obj[MAGSIZE];
+};
+
+struct kmem_cache {
+    struct spinlock lock;   // protects the slab lists
+    char *name;
+    uint size;              // object size, rounded up
+    uint perslab;           // objects per slab page
+    void (*ctor)(void*);
+    struct slab *partial;   // slabs with free objects
+    struct slab *full;      // slabs with none
+    struct magazine mag[NCPU];
+};
+
+struct slab {
+    struct kmem_cache *cache;
+    struct slab *next;      // cache's partial or full list
+    struct slab *prev;
+    void *free;             // free objects in this slab
+    uint inuse;             // objects handed out (incl. magazines)
+};
+
+#define SLABHDR  ((sizeof(struct slab) + 15) & ~15)
+
+struct {
+    struct spinlock lock;
+    struct kmem_cache cache[NSLABCACHE];
+    int ncache;
+} slabtable;
+
+void slabinit(void) {
+    initlock(&slabtable.lock, "slabtable");
+}
+
+// Create a cache of objects of the given size. ctor, if not 0,
+// is applied to every object when its slab is first allocated.
+struct kmem_cache* kmem_cache_create(char *name, uint size, void (*ctor)(void*)) {
+    struct kmem_cache *c;
+
+    size = (size + 7) & ~7;
+    if(size < sizeof(void*) || size > PGSIZE - SLABHDR)
+        panic("kmem_cache_create: size");
+
+    acquire(&slabtable.lock);
+    if(slabtable.ncache >= NSLABCACHE)
+        panic("kmem_cache_create: too many caches");
+    c = &slabtable.cache[slabtable.ncache++];
+    release(&slabtable.lock);
+
+    memset(c, 0, sizeof(*c));
+    initlock(&c->lock, name);
+    c->name = name;
+    c->size = size;
+    c->perslab = (PGSIZE - SLABHDR) / size;
+    c->ctor = ctor;
+    return c;
+}
+
+static void slab_unlink(struct slab **list, struct slab *s) {
+    if(s->prev)
+        s->prev->next = s->next;
+    else
+        *list = s->next;
+    if(s->next)
+        s->next->prev = s->prev;
+    s->next = s->prev = 0;
+}
+
+static void slab_push(struct slab **list, struct slab *s) {
+    s->prev = 0;
+    s->next = *list;
+    if(*list)
+        (*list)->prev = s;
+    *list = s;
+}
+
+// Allocate and construct a new slab. Called without c->lock held,
+// since constructors may take locks of their own.
+static struct slab* slab_grow(struct kmem_cache *c) {
+    struct slab *s;
+    char *obj;
+    int i;
+
+    if((s = (struct slab*)kalloc()) == 0)
+        return 0;
+    s->cache = c;
+    s->next = s->prev = 0;
+    s->free = 0;
+    s->inuse = 0;
+    for(i = c->perslab - 1; i >= 0; i--) {
+        obj = (char*)s + SLABHDR + i*c->size;
+        if(c->ctor)
+            c->ctor(obj);
+        *(void**)obj = s->free;
+        s->free = obj;
+    }
+    return s;
+}
+
+// Take one object off the slab lists. Caller holds c->lock.
+static void* slab_take(struct kmem_cache *c) {
+    struct slab *s;
+    void *obj;
+
+    if((s = c->partial) == 0)
+        return 0;
+    obj = s->free;
+    s->free = *(void**)obj;
+    s->inuse++;
+    if(s->free == 0) {
+        slab_unlink(&c->partial, s);
+        slab_push(&c->full, s);
+    }
+    return obj;
+}
+
+// Return one object to its slab. Caller holds c->lock.
+// Returns a slab page that should be handed back to kalloc, or 0.
+static struct slab* slab_put(struct kmem_cache *c, void *obj) {
+    struct slab *s;
+
+    s = (struct slab*)PGROUNDDOWN((uint)obj);
+    if(s->cache != c)
+        panic("kmem_cache_free: wrong cache");
+    if(s->free == 0) {
+        slab_unlink(&c->full, s);
+        slab_push(&c->partial, s);
+    }
+    *(void**)obj = s->free;
+    s->free = obj;
+    if(--s->inuse == 0 && (s->next || s->prev)) {
+        slab_unlink(&c->partial, s);
+        return s;
+    }
+    return 0;
+}
+
+void* kmem_cache_alloc(struct kmem_cache *c) {
+    struct magazine *m;
+    struct slab *s;
+    void *obj;
+
+    pushcli();
+    m = &c->mag[cpuid()];
+    if(m->n > 0) {
+        obj = m->obj[--m->n];
+        popcli();
+        return obj;
+    }
+
+    // Magazine empty: refill half of it from the slabs.
+    acquire(&c->lock);
+    while(m->n < MAGSIZE/2 && (obj = slab_take(c)) != 0)
+        m->obj[m->n++] = obj;
+    release(&c->lock);
+    if(m->n > 0) {
+        obj = m->obj[--m->n];
+        popcli();
+        return obj;
+    }
+    popcli();
+
+    // No free objects anywhere: build a new slab.
+    do {
+        if((s = slab_grow(c)) == 0)
+            return 0;
+        acquire(&c->lock);
+        slab_push(&c->partial, s);
+        obj = slab_take(c);
+        release(&c->lock);
+    } while(obj == 0);
+    return obj;
+}
+
+void kmem_cache_free(struct kmem_cache *c, void *obj) {
+    struct magazine *m;
+    struct slab *s, *empty[MAGSIZE/2];
+    int i, n;
+
+    pushcli();
+    m = &c->mag[cpuid()];
+    if(m->n < MAGSIZE) {
+        m->obj[m->n++] = obj;
+        popcli();
+        return;
+    }
+
+    // Magazine full: flush half of it back to the slabs.
+    n = 0;
+    acquire(&c->lock);
+    for(i = 0; i < MAGSIZE/2; i++)
+        if((s = slab_put(c, m->obj[--m->n])) != 0)
+            empty[n++] = s;
+    release(&c->lock);
+    m->obj[m->n++] = obj;
+    popcli();
+
+    for(i = 0; i < n; i++)
+        kfree((char*)empty[i]);
+}
@@ -9,3 +9,10 @@ struct stat {
     short nlink; // Number of links to file
     uint size; // Size of file in bytes
 };
+
+// A directory entry, as returned by getdents(). st.ino is always
+// filled in; the rest of st only if getdents() was asked to.
+struct dirstat {
+    char name[16];  // DIRSIZ (fs.h) at most, nul-terminated
+    struct stat st;
+};
@@ -1,7 +1,7 @@
 // Demonstrate that moving the "acquire" in iderw after the loop that
-// appends to the idequeue results in a race.
+// appends to the idequeue (ideappend) results in a race.
 
-// For this to work, you should also add a spin within iderw's
+// For this to work, you should also add a spin within ideappend's
 // idequeue traversal loop.  Adding the following demonstrated a panic
 // after about 5 runs of stressfs in QEMU on a 2.1GHz CPU:
 //    for (i = 0; i < 40000; i++)
@@ -12,6 +12,43 @@
 #include "user.h"
 #include "fs.h"
 #include "fcntl.h"
+#include "ring.h"
+
+#define NOPS 100
+
+// The reads and writes go through a submission ring, NOPS to
+// a trap, so that many of them are queued on the disk at once.
+static struct ring ring;
+
+static void submit(int op, int fd, void *addr, int n) {
+    struct sqe *e = &ring.sq[ring.sqtail % NRING];
+
+    e->op = op;
+    e->fd = fd;
+    e->addr = (uint)addr;
+    e->n = n;
+    e->data = ring.sqtail;
+    ring.sqtail++;
+}
+
+// Run everything submitted, and check that it all worked.
+static void drain(void) {
+    struct cqe *c;
+
+    while(ring.sqhead != ring.sqtail) {
+        if(ringenter(NRING) < 0) {
+            printf(1, "stressfs: ringenter failed\n");
+            exit();
+        }
+        for(; ring.cqhead != ring.cqtail; ring.cqhead++) {
+            c = &ring.cq[ring.cqhead % NRING];
+            if(c->res < 0) {
+                printf(1, "stressfs: request %d failed\n", c->data);
+                exit();
+            }
+        }
+    }
+}
 
 int main(int argc, char *argv[]) {
     int fd, i;
@@ -27,19 +64,21 @@ int main(int argc, char *argv[]) {
 
     printf(1, "write %d\n", i);
 
+    ringsetup(&ring);
     path[8] += i;
     fd = open(path, O_CREATE | O_RDWR);
-    for(i = 0; i < 20; i++)
-//    printf(fd, "%d\n", i);
-        write(fd, data, sizeof(data));
-    close(fd);
+    for(i = 0; i < NOPS; i++)
+        submit(RING_WRITE, fd, data, sizeof(data));
+    submit(RING_CLOSE, fd, 0, 0);
+    drain();
 
     printf(1, "read\n");
 
     fd = open(path, O_RDONLY);
-    for (i = 0; i < 20; i++)
-        read(fd, data, sizeof(data));
-    close(fd);
+    for (i = 0; i < NOPS; i++)
+        submit(RING_READ, fd, data, sizeof(data));
+    submit(RING_CLOSE, fd, 0, 0);
+    drain();
 
     wait();
 
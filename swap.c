@@ -0,0 +1,204 @@
+// Swap space and the page-out daemon.
+//
+// mkfs leaves a swap area of sb.nswap pages after the file
+// system. When free memory runs low, kswapd writes cold user
+// pages there and frees them. The PTE of a swapped-out page has
+// PTE_P clear and PTE_SWAP set, and holds the swap slot in place
+// of the frame address, next to the page's other flags; the
+// page fault handler reads the page back in (see swapin in vm.c).
+//
+// kswapd chooses pages with the clock algorithm (swapvictim in
+// proc.c, clockscan in vm.c): the hand sweeps over the user pages
+// of every process, clearing PTE_A on pages used since it last
+// came by and taking the first one found with PTE_A still clear.
+//
+// Slots are reference counted, so that fork() can hand a
+// swapped-out page to the child without reading it in. Swap I/O
+// goes around the buffer cache, one block at a time through
+// swap.buf, whose sleep-lock serializes all of it.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "buf.h"
+#include "x86.h"
+
+struct {
+    struct spinlock lock;   // protects everything but buf
+    struct buf buf;
+    uint dev;
+    uint start;             // first block of the swap area
+    uint nslot;
+    uint hand;              // where to look for a free slot
+    ushort ref[NSWAP];
+    int want;               // processes waiting for memory
+    int kick;               // free memory ran low; see swapkick
+    int progress;           // did kswapd's last pass free anything?
+} swap;
+
+void swapinit(int dev) {
+    struct superblock sb;
+
+    initlock(&swap.lock, "swap");
+    initsleeplock(&swap.buf.lock, "swapbuf");
+    readsb(dev, &sb);
+    swap.dev = dev;
+    swap.start = sb.swapstart;
+    swap.nslot = sb.nswap < NSWAP ? sb.nswap : NSWAP;
+    cprintf("swap: %d pages at block %d\n", swap.nslot, swap.start);
+}
+
+// Allocate a swap slot. Returns -1 if swap is full.
+int swapalloc(void) {
+    uint i, s;
+
+    acquire(&swap.lock);
+    for(i = 0; i < swap.nslot; i++) {
+        s = (swap.hand + i) % swap.nslot;
+        if(swap.ref[s] == 0) {
+            swap.ref[s] = 1;
+            swap.hand = s + 1;
+            release(&swap.lock);
+            return s;
+        }
+    }
+    release(&swap.lock);
+    return -1;
+}
+
+// Take another reference to slot s.
+void swapdup(uint s) {
+    acquire(&swap.lock);
+    if(s >= swap.nslot || swap.ref[s] == 0 || swap.ref[s] == 0xffff)
+        panic("swapdup");
+    swap.ref[s]++;
+    release(&swap.lock);
+}
+
+// Drop a reference to slot s.
+void swapfree(uint s) {
+    acquire(&swap.lock);
+    if(s >= swap.nslot || swap.ref[s] == 0)
+        panic("swapfree");
+    swap.ref[s]--;
+    release(&swap.lock);
+}
+
+// Read (write == 0) or write page mem from/to slot s.
+// Caller must hold swap.buf.lock.
+static void swaprw(uint s, char *mem, int write) {
+    struct buf *b = &swap.buf;
+    int i;
+
+    for(i = 0; i < SWAPBPP; i++) {
+        b->dev = swap.dev;
+        b->blockno = swap.start + s*SWAPBPP + i;
+        if(write) {
+            memmove(b->data, mem + i*BSIZE, BSIZE);
+            b->flags = B_DIRTY;
+        } else
+            b->flags = 0;
+        iderw(b);
+        if(!write)
+            memmove(mem + i*BSIZE, b->data, BSIZE);
+    }
+}
+
+// Read slot s into mem. Waits for a page-out of the slot that
+// is still in progress.
+void swapread(uint s, char *mem) {
+    acquiresleep(&swap.buf.lock);
+    swaprw(s, mem, 0);
+    releasesleep(&swap.buf.lock);
+}
+
+// Swap out one page. Returns 0, or -1 if swap is full or there
+// is nothing left to swap.
+static int pageout(void) {
+    char *mem;
+    int s;
+
+    if((s = swapalloc()) < 0)
+        return -1;
+
+    // Take the buffer before unmapping the victim, so that a
+    // fault on it waits in swapread() until it has been written.
+    acquiresleep(&swap.buf.lock);
+    if((mem = swapvictim(s)) == 0) {
+        releasesleep(&swap.buf.lock);
+        swapfree(s);
+        return -1;
+    }
+    swaprw(s, mem, 1);
+    releasesleep(&swap.buf.lock);
+    kfree(mem);
+    return 0;
+}
+
+// Wait for kswapd to free some memory. Returns 1 if it did,
+// 0 if there was nothing it could do.
+int swapwait(void) {
+    int progress;
+
+    acquire(&swap.lock);
+    if(swap.nslot == 0) {
+        release(&swap.lock);
+        return 0;
+    }
+    swap.want++;
+    wakeup(&swap);
+    sleep(&swap.want, &swap.lock);
+    progress = swap.progress;
+    release(&swap.lock);
+    return progress;
+}
+
+// Wake kswapd, if nobody has yet. kalloc() calls this when
+// free memory runs low. It may hold spin-locks that wakeup()
+// needs, in which case interrupts are off; kswapd will hear
+// from a later kalloc() or from swapwait() instead.
+void swapkick(void) {
+    if(swap.nslot == 0 || swap.kick || !(readeflags() & FL_IF))
+        return;
+    acquire(&swap.lock);
+    swap.kick = 1;
+    wakeup(&swap);
+    release(&swap.lock);
+}
+
+// The page-out daemon. Sleeps until swapkick() or swapwait()
+// says memory is short.
+void kswapd(void) {
+    int freed;
+
+    for(;;) {
+        acquire(&swap.lock);
+        while(!swap.kick && swap.want == 0)
+            sleep(&swap, &swap.lock);
+        swap.kick = 0;
+        release(&swap.lock);
+
+        if(getNumFreePages() >= SWAPLOW && swap.want == 0)
+            continue;
+
+        // Dropping cached file pages is cheaper than swapping.
+        freed = 0;
+        while(getNumFreePages() < SWAPHIGH) {
+            if(pcreclaim(1) == 0 && pageout() < 0)
+                break;
+            freed++;
+        }
+
+        acquire(&swap.lock);
+        swap.progress = freed > 0 || getNumFreePages() > 0;
+        swap.want = 0;
+        wakeup(&swap.want);
+        release(&swap.lock);
+    }
+}
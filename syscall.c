@@ -19,6 +19,8 @@ int fetchint(uint addr, int *ip) {
 
     if(addr >= curproc->sz || addr+4 > curproc->sz)
         return -1;
+    if(uvmprefault(addr, 4, 0) < 0)
+        return -1;
     *ip = *(int*)(addr);
     return 0;
 }
@@ -35,6 +37,8 @@ int fetchstr(uint addr, char **pp) {
     *pp = (char*)addr;
     ep = (char*)curproc->sz;
     for(s = *pp; s < ep; s++) {
+        if(((uint)s % PGSIZE == 0 || s == *pp) && uvmprefault((uint)s, 1, 0) < 0)
+            return -1;
         if(*s == 0)
             return s - *pp;
     }
@@ -46,21 +50,32 @@ int argint(int n, int *ip) {
     return fetchint((myproc()->tf->esp) + 4 + 4*n, ip);
 }
 
-// Fetch the nth word-sized system call argument as a pointer
-// to a block of memory of size bytes.  Check that the pointer
-// lies within the process address space.
-int argptr(int n, char **pp, int size) {
+static int argbuf(int n, char **pp, int size, int write) {
     int i;
-    struct proc *curproc = myproc();
 
     if(argint(n, &i) < 0)
         return -1;
-    if(size < 0 || (uint)i >= curproc->sz || (uint)i+size > curproc->sz)
+    if(size < 0 || !uvmvalid(i, size))
+        return -1;
+    if(uvmprefault(i, size, write) < 0)
         return -1;
     *pp = (char*)i;
     return 0;
 }
 
+// Fetch the nth word-sized system call argument as a pointer
+// to a block of memory of size bytes.  Check that the pointer
+// lies within the process address space.
+int argptr(int n, char **pp, int size) {
+    return argbuf(n, pp, size, 0);
+}
+
+// Like argptr(), for a block the system call writes to. Also
+// check that the process may write it.
+int argout(int n, char **pp, int size) {
+    return argbuf(n, pp, size, 1);
+}
+
 // Fetch the nth word-sized system call argument as a string pointer.
 // Check that the pointer is valid and the string is nul-terminated.
 // (There is no shared writable memory, so the string can't change
@@ -101,6 +116,18 @@ extern int sys_pdump(void);
 extern int sys_testwait(void);
 extern int sys_yield(void);
 extern int sys_getpinfo(void);
+extern int sys_nanosleep(void);
+extern int sys_mmap(void);
+extern int sys_munmap(void);
+extern int sys_ringsetup(void);
+extern int sys_ringenter(void);
+extern int sys_pread(void);
+extern int sys_pwrite(void);
+extern int sys_readv(void);
+extern int sys_writev(void);
+extern int sys_sendfile(void);
+extern int sys_getdents(void);
+extern int sys_fstatat(void);
 
 static int (*syscalls[])(void) = {
     [SYS_fork]              sys_fork,
@@ -132,6 +159,18 @@ static int (*syscalls[])(void) = {
     [SYS_testwait]          sys_testwait,
     [SYS_yield]             sys_yield,
     [SYS_getpinfo]          sys_getpinfo,
+    [SYS_nanosleep]         sys_nanosleep,
+    [SYS_mmap]              sys_mmap,
+    [SYS_munmap]            sys_munmap,
+    [SYS_ringsetup]         sys_ringsetup,
+    [SYS_ringenter]         sys_ringenter,
+    [SYS_pread]             sys_pread,
+    [SYS_pwrite]            sys_pwrite,
+    [SYS_readv]             sys_readv,
+    [SYS_writev]            sys_writev,
+    [SYS_sendfile]          sys_sendfile,
+    [SYS_getdents]          sys_getdents,
+    [SYS_fstatat]           sys_fstatat,
 };
 
 void syscall(void) {
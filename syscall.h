@@ -28,3 +28,15 @@
 #define SYS_testwait 27
 #define SYS_yield 28
 #define SYS_getpinfo 29
+#define SYS_nanosleep 30
+#define SYS_mmap 31
+#define SYS_munmap 32
+#define SYS_ringsetup 33
+#define SYS_ringenter 34
+#define SYS_pread 35
+#define SYS_pwrite 36
+#define SYS_readv 37
+#define SYS_writev 38
+#define SYS_sendfile 39
+#define SYS_getdents 40
+#define SYS_fstatat 41
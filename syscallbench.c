@@ -0,0 +1,38 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "syscall.h"
+#include "traps.h"
+
+// Null system call latency: getpid() in a loop, through the
+// usual stub (sysenter, where the CPU has it) and through int.
+
+#define N  1000000
+
+static int intgetpid(void) {
+    int pid;
+
+    asm volatile("int %1" : "=a" (pid) : "i" (T_SYSCALL), "a" (SYS_getpid) : "memory");
+    return pid;
+}
+
+static void run(char *name, int (*fn)(void)) {
+    uint t0, t;
+    int i;
+
+    t0 = uptime();
+    for(i = 0; i < N; i++)
+        fn();
+    t = uptime() - t0;
+    printf(1, "%s: %d ticks for %d calls\n", name, t, N);
+}
+
+int main(int argc, char *argv[]) {
+    if(intgetpid() != getpid()) {
+        printf(1, "syscallbench: getpid paths disagree\n");
+        exit();
+    }
+    run("getpid", getpid);
+    run("getpid via int", intgetpid);
+    exit();
+}
@@ -15,7 +15,12 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "mman.h"
 #include "pstat.h"
+#include "ring.h"
+#include "uio.h"
+
+#define NGETDENTS  16   // entries getdents() stats at a time
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
@@ -34,6 +39,14 @@ static int argfd(int n, int *pfd, struct file **pf) {
     return 0;
 }
 
+// Check that [addr, addr+n) is user memory and fault it in, as
+// argptr() and argout() do for system call arguments.
+static int userbuf(uint addr, int n, int write) {
+    if(n < 0 || !uvmvalid(addr, n) || uvmprefault(addr, n, write) < 0)
+        return -1;
+    return 0;
+}
+
 // Allocate a file descriptor for the given file.
 // Takes over file reference from caller on success.
 static int fdalloc(struct file *f) {
@@ -66,7 +79,7 @@ int sys_read(void) {
     int n;
     char *p;
 
-    if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0)
+    if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argout(1, &p, n) < 0)
         return -1;
     return fileread(f, p, n);
 }
@@ -81,6 +94,79 @@ int sys_write(void) {
     return filewrite(f, p, n);
 }
 
+int sys_pread(void) {
+    struct file *f;
+    int n, off;
+    char *p;
+
+    if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argout(1, &p, n) < 0 ||
+       argint(3, &off) < 0 || off < 0)
+        return -1;
+    return filepread(f, p, n, off);
+}
+
+int sys_pwrite(void) {
+    struct file *f;
+    int n, off;
+    char *p;
+
+    if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0 ||
+       argint(3, &off) < 0 || off < 0)
+        return -1;
+    return filepwrite(f, p, n, off);
+}
+
+// Copy up to n bytes from one file to another inside the kernel.
+int sys_sendfile(void) {
+    struct file *out, *in;
+    int n;
+
+    if(argfd(0, 0, &out) < 0 || argfd(1, 0, &in) < 0 || argint(2, &n) < 0)
+        return -1;
+    return filesend(out, in, n);
+}
+
+// Fetch the iovec array argument n, with cnt entries, into iov,
+// and check all of the buffers it points to, for writing if
+// write is set.
+static int argiov(int n, int cnt, struct iovec *iov, int write) {
+    struct iovec *uiov;
+    uint tot;
+    int i;
+
+    if(cnt < 0 || cnt > IOV_MAX || argptr(n, (void*)&uiov, cnt*sizeof(*uiov)) < 0)
+        return -1;
+    memmove(iov, uiov, cnt*sizeof(*uiov));
+    tot = 0;
+    for(i = 0; i < cnt; i++) {
+        if(iov[i].iov_len > 0x7fffffff - tot ||
+           userbuf((uint)iov[i].iov_base, iov[i].iov_len, write) < 0)
+            return -1;
+        tot += iov[i].iov_len;
+    }
+    return 0;
+}
+
+int sys_readv(void) {
+    struct file *f;
+    struct iovec iov[IOV_MAX];
+    int cnt;
+
+    if(argfd(0, 0, &f) < 0 || argint(2, &cnt) < 0 || argiov(1, cnt, iov, 1) < 0)
+        return -1;
+    return filereadv(f, iov, cnt);
+}
+
+int sys_writev(void) {
+    struct file *f;
+    struct iovec iov[IOV_MAX];
+    int cnt;
+
+    if(argfd(0, 0, &f) < 0 || argint(2, &cnt) < 0 || argiov(1, cnt, iov, 0) < 0)
+        return -1;
+    return filewritev(f, iov, cnt);
+}
+
 int sys_close(void) {
     int fd;
     struct file *f;
@@ -96,7 +182,7 @@ int sys_fstat(void) {
     struct file *f;
     struct stat *st;
 
-    if(argfd(0, 0, &f) < 0 || argptr(1, (void*)&st, sizeof(*st)) < 0)
+    if(argfd(0, 0, &f) < 0 || argout(1, (void*)&st, sizeof(*st)) < 0)
         return -1;
     return filestat(f, st);
 }
@@ -262,15 +348,12 @@ static struct inode* create(char *path, short type, short major, short minor) {
     return ip;
 }
 
-int sys_open(void) {
-    char *path;
-    int fd, omode;
+// Open path with mode omode in a new file descriptor.
+static int fileopen(char *path, int omode) {
+    int fd;
     struct file *f;
     struct inode *ip;
 
-    if(argstr(0, &path) < 0 || argint(1, &omode) < 0)
-        return -1;
-
     begin_op();
 
     if(omode & O_CREATE) {
@@ -310,6 +393,95 @@ int sys_open(void) {
     return fd;
 }
 
+int sys_open(void) {
+    char *path;
+    int omode;
+
+    if(argstr(0, &path) < 0 || argint(1, &omode) < 0)
+        return -1;
+    return fileopen(path, omode);
+}
+
+// Read up to n entries of directory fd into ds, skipping empty
+// slots, and with withstat set, stat() each one too. Returns the
+// number of entries, or 0 at the end of the directory.
+int sys_getdents(void) {
+    struct file *f;
+    struct dirstat *ds;
+    struct dirent de;
+    struct inode *dp, *ips[NGETDENTS];
+    int n, withstat, cnt, i, k;
+
+    if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argint(3, &withstat) < 0)
+        return -1;
+    if(n < 0 || n > 0x7fffffff / sizeof(*ds) || argout(1, (void*)&ds, n*sizeof(*ds)) < 0)
+        return -1;
+    if(f->type != FD_INODE || !f->readable)
+        return -1;
+    dp = f->ip;
+
+    for(cnt = 0; cnt < n; cnt += k) {
+        // Take a batch of entries with the directory locked, and
+        // stat them after unlocking it: ".." must not be locked
+        // while its child is. The references taken here keep the
+        // inodes from being freed in between.
+        ilock(dp);
+        if(dp->type != T_DIR) {
+            iunlock(dp);
+            return -1;
+        }
+        for(k = 0; cnt + k < n && k < NGETDENTS && f->off + sizeof(de) <= dp->size; ) {
+            if(readi(dp, (char*)&de, f->off, sizeof(de)) != sizeof(de))
+                break;
+            f->off += sizeof(de);
+            if(de.inum == 0)
+                continue;
+            memset(&ds[cnt+k], 0, sizeof(*ds));
+            memmove(ds[cnt+k].name, de.name, DIRSIZ);
+            ds[cnt+k].st.dev = dp->dev;
+            ds[cnt+k].st.ino = de.inum;
+            if(withstat)
+                ips[k] = iget(dp->dev, de.inum);
+            k++;
+        }
+        iunlock(dp);
+        if(k == 0)
+            break;
+
+        for(i = 0; withstat && i < k; i++) {
+            begin_op();
+            ilock(ips[i]);
+            stati(ips[i], &ds[cnt+i].st);
+            iunlockput(ips[i]);
+            end_op();
+        }
+    }
+    return cnt;
+}
+
+// stat() path, which if relative starts at directory fd.
+int sys_fstatat(void) {
+    struct file *f;
+    struct stat *st;
+    struct inode *ip;
+    char *path;
+
+    if(argfd(0, 0, &f) < 0 || argstr(1, &path) < 0 || argout(2, (void*)&st, sizeof(*st)) < 0)
+        return -1;
+    if(f->type != FD_INODE)
+        return -1;
+    begin_op();
+    if((ip = nameiat(f->ip, path)) == 0) {
+        end_op();
+        return -1;
+    }
+    ilock(ip);
+    stati(ip, st);
+    iunlockput(ip);
+    end_op();
+    return 0;
+}
+
 int sys_mkdir(void) {
     char *path;
     struct inode *ip;
@@ -389,13 +561,12 @@ int sys_exec(void) {
     return exec(path, argv);
 }
 
-int sys_pipe(void) {
-    int *fd;
+// Make a pipe, and put its read and write descriptors in fd[0]
+// and fd[1].
+static int fdpipe(int *fd) {
     struct file *rf, *wf;
     int fd0, fd1;
 
-    if(argptr(0, (void*)&fd, 2*sizeof(fd[0])) < 0)
-        return -1;
     if(pipealloc(&rf, &wf) < 0)
         return -1;
     fd0 = -1;
@@ -411,3 +582,155 @@ int sys_pipe(void) {
     return 0;
 }
 
+int sys_pipe(void) {
+    int *fd;
+
+    if(argout(0, (void*)&fd, 2*sizeof(fd[0])) < 0)
+        return -1;
+    return fdpipe(fd);
+}
+
+int sys_mmap(void) {
+    struct file *f;
+    int len, prot, flags, off;
+
+    if(argint(1, &len) < 0 || argint(2, &prot) < 0 ||
+       argint(3, &flags) < 0 || argint(5, &off) < 0)
+        return -1;
+    f = 0;
+    if(!(flags & MAP_ANONYMOUS) && argfd(4, 0, &f) < 0)
+        return -1;
+    return mmap(len, prot, flags, f, off);
+}
+
+//PAGEBREAK!
+// Submission rings.
+//
+// Instead of trapping once for each read() or write(), a process
+// can queue requests in a struct ring (ring.h) in its own memory,
+// registered with ringsetup(), and have ringenter() carry out a
+// batch of them at once. Before it starts on a batch, ringenter()
+// queues the disk reads that the batch's reads will need
+// (ireadahead), so that they are all in flight together instead
+// of one at a time.
+
+// Start the disk on the blocks wanted by the reads among the n
+// requests from sq[head]. Offsets are followed from one read to
+// the next; an open, close or pipe, which may change what a file
+// descriptor means, ends the look-ahead.
+static void ringreadahead(struct ring *r, uint head, uint n) {
+    struct proc *curproc = myproc();
+    struct sqe *e;
+    struct file *f;
+    uint off[NOFILE];
+    char seen[NOFILE];
+    uint i;
+
+    memset(seen, 0, sizeof(seen));
+    for(i = 0; i < n; i++) {
+        e = &r->sq[(head + i) & (NRING-1)];
+        if(e->op == RING_OPEN || e->op == RING_CLOSE || e->op == RING_PIPE)
+            break;
+        if(e->op != RING_READ || e->fd < 0 || e->fd >= NOFILE || e->n <= 0)
+            continue;
+        if((f = curproc->ofile[e->fd]) == 0 || f->type != FD_INODE || !f->readable)
+            continue;
+        if(!seen[e->fd]) {
+            off[e->fd] = f->off;
+            seen[e->fd] = 1;
+        }
+        ilock(f->ip);
+        ireadahead(f->ip, off[e->fd], e->n);
+        iunlock(f->ip);
+        off[e->fd] += e->n;
+    }
+}
+
+// Carry out one request. Returns what the system call would.
+static int ringop(struct sqe *e) {
+    struct proc *curproc = myproc();
+    struct file *f;
+    char *path;
+
+    f = 0;
+    if(e->op != RING_OPEN && e->op != RING_PIPE &&
+       (e->fd < 0 || e->fd >= NOFILE || (f = curproc->ofile[e->fd]) == 0))
+        return -1;
+
+    switch(e->op) {
+    case RING_READ:
+        if(userbuf(e->addr, e->n, 1) < 0)
+            return -1;
+        return fileread(f, (char*)e->addr, e->n);
+    case RING_WRITE:
+        if(userbuf(e->addr, e->n, 0) < 0)
+            return -1;
+        return filewrite(f, (char*)e->addr, e->n);
+    case RING_OPEN:
+        if(fetchstr(e->addr, &path) < 0)
+            return -1;
+        return fileopen(path, e->n);
+    case RING_CLOSE:
+        curproc->ofile[e->fd] = 0;
+        fileclose(f);
+        return 0;
+    case RING_FSTAT:
+        if(userbuf(e->addr, sizeof(struct stat), 1) < 0)
+            return -1;
+        return filestat(f, (struct stat*)e->addr);
+    case RING_PIPE:
+        if(userbuf(e->addr, 2*sizeof(int), 1) < 0)
+            return -1;
+        return fdpipe((int*)e->addr);
+    }
+    return -1;
+}
+
+// Register the ring at the given address, and empty it.
+int sys_ringsetup(void) {
+    struct ring *r;
+
+    if(argout(0, (void*)&r, sizeof(*r)) < 0)
+        return -1;
+    r->sqhead = r->sqtail = 0;
+    r->cqhead = r->cqtail = 0;
+    myproc()->ring = r;
+    return 0;
+}
+
+// Carry out up to n queued requests, stopping early if the
+// completion ring fills up. Returns the number carried out.
+int sys_ringenter(void) {
+    struct proc *curproc = myproc();
+    struct ring *r;
+    struct sqe e;
+    struct cqe *c;
+    uint head, i;
+    int n;
+
+    if(argint(0, &n) < 0 || n < 0 || (r = curproc->ring) == 0)
+        return -1;
+    // The ring is ordinary user memory, and may have been
+    // unmapped or paged out since ringsetup().
+    if(userbuf((uint)r, sizeof(*r), 1) < 0)
+        return -1;
+
+    head = r->sqhead;
+    if(r->sqtail - head > NRING || r->cqtail - r->cqhead > NRING)
+        return -1;
+    if(n > r->sqtail - head)
+        n = r->sqtail - head;
+
+    ringreadahead(r, head, n);
+    for(i = 0; i < n && !curproc->killed; i++) {
+        if(r->cqtail - r->cqhead == NRING)
+            break;
+        e = r->sq[(head + i) & (NRING-1)];
+        c = &r->cq[r->cqtail & (NRING-1)];
+        c->data = e.data;
+        c->res = ringop(&e);
+        r->cqtail++;
+        r->sqhead = head + i + 1;
+    }
+    return i;
+}
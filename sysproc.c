@@ -8,6 +8,7 @@
 #include "mmu.h"
 #include "proc.h"
 #include "pstat.h"
+#include "vdso.h"
 
 
 int sys_fork(void) {
@@ -51,20 +52,68 @@ int sys_sbrk(void) {
     return addr;
 }
 
+int sys_munmap(void) {
+    int addr, len;
+
+    if(argint(0, &addr) < 0 || argint(1, &len) < 0)
+        return -1;
+    return munmap(addr, len);
+}
+
+// Sleep for n ticks. Rather than wake up on every tick to
+// check the time, arm a timer that wakes us at the deadline.
+static int sleepticks(int n) {
+    struct proc *p = myproc();
+    uint ticks0;
+
+    acquire(&tickslock);
+    ticks0 = ticks;
+    while(ticks - ticks0 < n) {
+        if(p->killed) {
+            release(&tickslock);
+            return -1;
+        }
+        timer_add(&p->timer, ticks0 + n, wakeup, &p->timer);
+        sleep(&p->timer, &tickslock);
+        timer_del(&p->timer);
+    }
+    release(&tickslock);
+    return 0;
+}
+
 int sys_sleep(void) {
     int n;
-    uint ticks0;
 
     if(argint(0, &n) < 0)
         return -1;
+    return sleepticks(n);
+}
+
+// Sleep for ns nanoseconds. A high-resolution timer wakes us
+// at the TSC deadline, from a LAPIC timer interrupt that comes
+// early if need be, so a short sleep is not rounded up to a
+// tick. Until the TSC is calibrated, round up to whole ticks.
+int sys_nanosleep(void) {
+    struct proc *p = myproc();
+    uint64 deadline;
+    uint tpu;
+    int ns;
+
+    if(argint(0, &ns) < 0 || ns < 0)
+        return -1;
+    if((tpu = vdata->tscpertick / (TICKNS/1000)) == 0)
+        return sleepticks(ns / TICKNS + (ns % TICKNS != 0));
+    deadline = rdtsc() + (uint64)(ns / 1000) * tpu + (ns % 1000) * tpu / 1000;
+
     acquire(&tickslock);
-    ticks0 = ticks;
-    while(ticks - ticks0 < n) {
-        if(myproc()->killed) {
+    while(rdtsc() < deadline) {
+        if(p->killed) {
             release(&tickslock);
             return -1;
         }
-        sleep(&ticks, &tickslock);
+        hrtimer_add(&p->hrtimer, deadline, wakeup, &p->hrtimer);
+        sleep(&p->hrtimer, &tickslock);
+        hrtimer_del(&p->hrtimer);
     }
     release(&tickslock);
     return 0;
@@ -110,11 +159,11 @@ int sys_getpri(void) {
 
 int sys_testwait(void) {
     int *retime, *rutime, *stime;
-    if (argptr(0, (void*)&retime, sizeof(retime)) < 0)
+    if (argout(0, (void*)&retime, sizeof(retime)) < 0)
         return -1;
-    if (argptr(1, (void*)&rutime, sizeof(retime)) < 0)
+    if (argout(1, (void*)&rutime, sizeof(retime)) < 0)
         return -1;
-    if (argptr(2, (void*)&stime, sizeof(stime)) < 0)
+    if (argout(2, (void*)&stime, sizeof(stime)) < 0)
         return -1;
     return testwait(retime, rutime, stime);
 }
@@ -126,7 +175,7 @@ int sys_yield(void) {
 
 int sys_getpinfo(void) {
     struct pstat* ps;
-    if (argptr(0, (char**)&ps, sizeof(struct pstat)) < 0) {
+    if (argout(0, (char**)&ps, sizeof(struct pstat)) < 0) {
         return -1;
     }
     getpinfo(ps);
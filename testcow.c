@@ -1,6 +1,7 @@
 #include "types.h"
 #include "stat.h"
 #include "user.h"
+#include "fcntl.h"
 
 int a = 1;
 
@@ -134,6 +135,62 @@ void test3_original() {
     return;
 }
 
+// Start shcopy with its input from fd and return how many free
+// pages that cost, once it is waiting for a command.
+int startsh(int fd) {
+    char *argv[] = { "shcopy", 0 };
+    int n;
+
+    n = getNumFreePages();
+    if(fork() == 0) {
+        close(0);
+        dup(fd);
+        exec("shcopy", argv);
+        exit();
+    }
+    sleep(20);
+    return n - getNumFreePages();
+}
+
+// A second shell maps the first one's text frames. Writing to
+// the program drops them from the page cache, so a third shell
+// has to make its own: it costs more than the second by the
+// frames the second shared.
+void test4() {
+    char buf[512];
+    int fd, out, p[2], n, second, third;
+
+    fd = open("sh", 0);
+    out = open("shcopy", O_CREATE|O_RDWR);
+    while((n = read(fd, buf, sizeof(buf))) > 0)
+        write(out, buf, n);
+    close(fd);
+    close(out);
+
+    pipe(p);
+    startsh(p[0]);
+    second = startsh(p[0]);
+    out = open("shcopy", O_RDWR);
+    read(out, buf, 1);
+    close(out);
+    out = open("shcopy", O_RDWR);
+    write(out, buf, 1);
+    close(out);
+    third = startsh(p[0]);
+
+    close(p[0]);
+    close(p[1]);
+    wait();
+    wait();
+    wait();
+    unlink("shcopy");
+    printf(1,"\nsecond sh took %d pages, third %d\n", second, third);
+    if(third > second)
+        printf(1,"text sharing ok\n");
+    else
+        printf(1,"text sharing FAILED\n");
+}
+
 int main(void) {
     printf(1,"Test1 running....\n");
     test1();
@@ -157,5 +214,11 @@ int main(void) {
     test3_original();
     printf(1,"Test3 finished\n");
 
+    printf(1,"--------------------\n");
+
+    printf(1,"Test4 running....\n");
+    test4();
+    printf(1,"Test4 finished\n");
+
     exit();
 }
@@ -26,7 +26,7 @@ void test1() {
 
         pid = fork();
         if (pid == 0) {//child
-            j = (getpid() - 4) % 3; // ensures independence from the first son's pid when gathering the results in the second part of the program
+            j = (vgetpid() - 4) % 3; // ensures independence from the first son's pid when gathering the results in the second part of the program
             switch(j) {
             case 0:     //CPU‐bound process (CPU):
                 for (double z = 0; z < 1000000.0; z+= 0.1) {
@@ -121,6 +121,7 @@ void test2(void) {
     }
     pdump();
 
+    vgetpinfo(&ps);
     print_proc_info(&ps, 1);
     //exit();
 }
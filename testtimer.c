@@ -0,0 +1,59 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+// Checks sleep() and nanosleep(): many processes sleeping at
+// once must each wake no earlier than asked, and nanosleep()
+// should add up to roughly the requested time, even for sleeps
+// much shorter than a tick.
+
+#define NSLEEPER 50
+
+void sleepers(void) {
+    int i, pid, t0;
+
+    printf(1, "%d sleepers\n", NSLEEPER);
+    for(i = 0; i < NSLEEPER; i++) {
+        pid = fork();
+        if(pid < 0) {
+            printf(1, "fork failed\n");
+            exit();
+        }
+        if(pid == 0) {
+            // Spread the deadlines across several wheel slots
+            // and levels.
+            t0 = uptime();
+            sleep(1 + i * 7);
+            if(uptime() - t0 < 1 + i * 7)
+                printf(1, "sleeper %d woke early after %d ticks\n", i, uptime() - t0);
+            exit();
+        }
+    }
+    for(i = 0; i < NSLEEPER; i++)
+        wait();
+    printf(1, "sleepers ok\n");
+}
+
+void nanosleeps(void) {
+    int i, t0;
+
+    t0 = uptime();
+    nanosleep(250000000);
+    printf(1, "nanosleep(250ms): %d ticks\n", uptime() - t0);
+
+    t0 = uptime();
+    for(i = 0; i < 100; i++)
+        nanosleep(1000000);
+    printf(1, "100 x nanosleep(1ms): %d ticks\n", uptime() - t0);
+
+    t0 = uptime();
+    for(i = 0; i < 1000; i++)
+        nanosleep(50000);
+    printf(1, "1000 x nanosleep(50us): %d ticks\n", uptime() - t0);
+}
+
+int main(void) {
+    sleepers();
+    nanosleeps();
+    exit();
+}
@@ -0,0 +1,197 @@
+// Hierarchical timing wheel.
+//
+// Pending timers hang off one of NLEVEL wheels of WHEELSIZE
+// slots each. Level 0 has a slot per tick for timers due
+// within the next WHEELSIZE ticks; each slot of level n
+// covers WHEELSIZE times as many ticks as a slot of level
+// n-1. Every WHEELSIZE ticks the next slot of the level above
+// is emptied and its timers are re-filed one level down, so
+// adding, cancelling and expiring a timer are all O(1), and
+// a tick only looks at the timers that are actually due.
+//
+// The wheel is protected by tickslock, which the timer
+// interrupt holds while it calls timerexpire(). Timer
+// functions are called with tickslock held.
+//
+// Deadlines finer than a tick go on a list of high-resolution
+// timers instead, sorted by TSC deadline and also protected by
+// tickslock. Whenever the first of them is due before the next
+// tick, lapicarm() has the LAPIC timer interrupt early for it.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "x86.h"
+#include "spinlock.h"
+#include "timer.h"
+
+#define WHEELBITS   6
+#define WHEELSIZE   (1 << WHEELBITS)
+#define WHEELMASK   (WHEELSIZE - 1)
+#define NLEVEL      4
+#define MAXDELTA    ((1 << (WHEELBITS * NLEVEL)) - 1)
+
+extern struct spinlock tickslock;
+
+static struct timer wheel[NLEVEL][WHEELSIZE];   // list heads
+static uint wheeltime;   // next tick to be processed
+static struct hrtimer hrlist = { &hrlist, &hrlist };
+
+void timerinit(void) {
+    int l, i;
+
+    for(l = 0; l < NLEVEL; l++)
+        for(i = 0; i < WHEELSIZE; i++)
+            wheel[l][i].next = wheel[l][i].prev = &wheel[l][i];
+}
+
+static void timer_insert(struct timer *head, struct timer *t) {
+    t->prev = head->prev;
+    t->next = head;
+    head->prev->next = t;
+    head->prev = t;
+}
+
+static void timer_unlink(struct timer *t) {
+    t->prev->next = t->next;
+    t->next->prev = t->prev;
+}
+
+// File t in the slot that covers t->expires.
+static void timer_file(struct timer *t) {
+    uint delta;
+    int l;
+
+    if((int)(t->expires - wheeltime) < 0) {
+        // Already due: run at the next tick.
+        timer_insert(&wheel[0][wheeltime & WHEELMASK], t);
+        return;
+    }
+    delta = t->expires - wheeltime;
+    if(delta > MAXDELTA) {
+        delta = MAXDELTA;
+        t->expires = wheeltime + delta;
+    }
+    for(l = 0; delta >= WHEELSIZE; l++)
+        delta >>= WHEELBITS;
+    timer_insert(&wheel[l][(t->expires >> (l * WHEELBITS)) & WHEELMASK], t);
+}
+
+// Arrange for fn(arg) to be called from the timer interrupt
+// at tick expires. Caller holds tickslock.
+void timer_add(struct timer *t, uint expires, void (*fn)(void*), void *arg) {
+    if(!holding(&tickslock))
+        panic("timer_add");
+    if(t->pending)
+        timer_unlink(t);
+    t->expires = expires;
+    t->fn = fn;
+    t->arg = arg;
+    t->pending = 1;
+    timer_file(t);
+}
+
+// Cancel t if it has not fired yet. Caller holds tickslock.
+void timer_del(struct timer *t) {
+    if(!holding(&tickslock))
+        panic("timer_del");
+    if(t->pending) {
+        timer_unlink(t);
+        t->pending = 0;
+    }
+}
+
+// Move the timers in slot i of level l down a level.
+// Returns i, so that the caller knows whether level l
+// has wrapped around too.
+static int cascade(int l, int i) {
+    struct timer *head, *t;
+
+    head = &wheel[l][i];
+    while((t = head->next) != head) {
+        timer_unlink(t);
+        timer_file(t);
+    }
+    return i;
+}
+
+// Run the timers that are due by now. Called on every tick
+// with tickslock held.
+void timerexpire(void) {
+    struct timer *head, *t;
+    int i, l;
+
+    while((int)(ticks - wheeltime) >= 0) {
+        i = wheeltime & WHEELMASK;
+        if(i == 0)
+            for(l = 1; l < NLEVEL; l++)
+                if(cascade(l, (wheeltime >> (l * WHEELBITS)) & WHEELMASK) != 0)
+                    break;
+        wheeltime++;
+
+        head = &wheel[0][i];
+        while((t = head->next) != head) {
+            timer_unlink(t);
+            t->pending = 0;
+            t->fn(t->arg);
+        }
+    }
+}
+
+static void hrtimer_unlink(struct hrtimer *t) {
+    t->prev->next = t->next;
+    t->next->prev = t->prev;
+}
+
+// Arrange for fn(arg) to be called from a timer interrupt once
+// the TSC reaches expires. Caller holds tickslock.
+void hrtimer_add(struct hrtimer *t, uint64 expires, void (*fn)(void*), void *arg) {
+    struct hrtimer *q;
+
+    if(!holding(&tickslock))
+        panic("hrtimer_add");
+    if(t->pending)
+        hrtimer_unlink(t);
+    t->expires = expires;
+    t->fn = fn;
+    t->arg = arg;
+    t->pending = 1;
+    for(q = hrlist.next; q != &hrlist && q->expires <= expires; q = q->next)
+        ;
+    t->prev = q->prev;
+    t->next = q;
+    q->prev->next = t;
+    q->prev = t;
+    lapicarm(expires);
+}
+
+// Cancel t if it has not fired yet. Caller holds tickslock.
+void hrtimer_del(struct hrtimer *t) {
+    if(!holding(&tickslock))
+        panic("hrtimer_del");
+    if(t->pending) {
+        hrtimer_unlink(t);
+        t->pending = 0;
+    }
+}
+
+// Run the high-resolution timers that are due by now, and arm
+// this CPU for the next one. Called on every timer interrupt,
+// on every CPU, without tickslock.
+void hrtimerexpire(void) {
+    struct hrtimer *t;
+
+    // Nothing to do most of the time; a timer added meanwhile
+    // arms the CPU that added it.
+    if(hrlist.next == &hrlist)
+        return;
+    acquire(&tickslock);
+    while((t = hrlist.next) != &hrlist && t->expires <= rdtsc()) {
+        hrtimer_unlink(t);
+        t->pending = 0;
+        t->fn(t->arg);
+    }
+    if(t != &hrlist)
+        lapicarm(t->expires);
+    release(&tickslock);
+}
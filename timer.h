@@ -0,0 +1,19 @@
+// Kernel timers, kept in a hierarchical timing wheel (timer.c).
+struct timer {
+    struct timer *next;     // slot list
+    struct timer *prev;
+    uint expires;           // tick at which to call fn
+    void (*fn)(void*);
+    void *arg;
+    int pending;            // on the wheel
+};
+
+// High-resolution timers, in a list sorted by deadline.
+struct hrtimer {
+    struct hrtimer *next;
+    struct hrtimer *prev;
+    uint64 expires;         // TSC value at which to call fn
+    void (*fn)(void*);
+    void *arg;
+    int pending;            // on the list
+};
@@ -29,15 +29,20 @@ void idtinit(void) {
     lidt(idt, sizeof(idt));
 }
 
+// A system call, by int or sysenter (see trapasm.S).
+void systrap(struct trapframe *tf) {
+    if(myproc()->killed)
+        exit();
+    myproc()->tf = tf;
+    syscall();
+    if(myproc()->killed)
+        exit();
+}
+
 //PAGEBREAK: 41
 void trap(struct trapframe *tf) {
     if(tf->trapno == T_SYSCALL) {
-        if(myproc()->killed)
-            exit();
-        myproc()->tf = tf;
-        syscall();
-        if(myproc()->killed)
-            exit();
+        systrap(tf);
         return;
     }
 
@@ -49,16 +54,20 @@ void trap(struct trapframe *tf) {
         break;
 
     case T_IRQ0 + IRQ_TIMER:
-        if(cpuid() == 0) {
+        // Only a full tick on CPU 0 advances the clock; an early
+        // interrupt is for a high-resolution timer.
+        if(lapictimer() && cpuid() == 0) {
             acquire(&tickslock);
             ticks++;
             updateStats();
+            vdsotick();
             if (ticks % 20 == 0) {
                 resetPriority();
             }
-            wakeup(&ticks);
+            timerexpire();
             release(&tickslock);
         }
+        hrtimerexpire();
         lapiceoi();
         break;
     case T_IRQ0 + IRQ_IDE:
@@ -68,6 +77,11 @@ void trap(struct trapframe *tf) {
     case T_IRQ0 + IRQ_IDE+1:
         // Bochs generates spurious IDE1 interrupts.
         break;
+    case T_TLBFLUSH:
+        tlbintr();
+        lapiceoi();
+        break;
+
     case T_IRQ0 + IRQ_KBD:
         kbdintr();
         lapiceoi();
@@ -107,9 +121,14 @@ void trap(struct trapframe *tf) {
 
     // Force process to give up CPU on clock tick.
     // If interrupts were on while locks held, would need to check nlock.
+    // A process preempted in user mode may have its pages
+    // swapped out while it waits to run again.
     if(myproc() && myproc()->state == RUNNING &&
-       tf->trapno == T_IRQ0+IRQ_TIMER)
+       tf->trapno == T_IRQ0+IRQ_TIMER) {
+        myproc()->swappable = (tf->cs&3) == DPL_USER;
         yield();
+        myproc()->swappable = 0;
+    }
 
     // Check if the process has been killed since we yielded
     if(myproc() && myproc()->killed && (tf->cs&3) == DPL_USER)
@@ -1,4 +1,5 @@
 typedef unsigned int uint;
 typedef unsigned short ushort;
 typedef unsigned char uchar;
+typedef unsigned long long uint64;
 typedef uint pde_t;
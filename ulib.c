@@ -127,4 +127,4 @@ void print_proc_info(struct pstat* ps, int verbose) {
         }
     }
     printf(1, "Total number of processes: %d\n", count);
-}
\ No newline at end of file
+}
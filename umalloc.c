@@ -3,82 +3,263 @@
 #include "user.h"
 #include "param.h"
 
-// Memory allocator by Kernighan and Ritchie,
-// The C programming Language, 2nd ed.  Section 8.7.
+// Size-class memory allocator.
+//
+// Small requests (up to MAXSMALL bytes) are rounded up to a power
+// of two and carved out of slab pages: each 4096-byte page holds
+// objects of a single size class behind a small page header.
+// Every class keeps a list of pages that still have free objects,
+// so malloc() and free() of a small object are O(1).
+//
+// Larger requests get their own run of whole pages. Free page runs
+// are kept in an address-ordered list and coalesced, and a run that
+// ends at the program break is handed back to the kernel with a
+// negative sbrk().
+//
+// free() finds an object's header by rounding its address down to
+// the page boundary, so every allocation must start in the same
+// page as its header.
 
-typedef long Align;
+#define PAGESIZE   4096
+#define MINSHIFT   4                        // smallest class is 16 bytes
+#define NCLASS     7                        // 16, 32, ..., 1024
+#define MAXSMALL   (1 << (MINSHIFT + NCLASS - 1))
+#define LARGE      NCLASS                   // pg->class of a large block
 
-union header {
-    struct {
-        union header *ptr;
-        uint size;
-    } s;
-    Align x;
+// Header at the start of every page handed out by the allocator.
+struct page {
+    ushort class;          // size class, or LARGE
+    ushort nfree;          // free objects left in this slab page
+    union {
+        struct {
+            void *free;         // free objects in this page
+            struct page *next;  // pages of this class with free objects
+            struct page *prev;
+        } s;
+        uint npages;       // LARGE: length of the run in pages
+    } u;
 };
 
-typedef union header Header;
+#define HDRSIZE   ((sizeof(struct page) + 15) & ~15)
 
-static Header base;
-static Header *freep;
+// A run of free pages, linked in address order.
+struct run {
+    uint npages;
+    struct run *next;
+};
 
-void free(void *ap) {
-    Header *bp, *p;
-
-    bp = (Header*)ap - 1;
-    for(p = freep; !(bp > p && bp < p->s.ptr); p = p->s.ptr)
-        if(p >= p->s.ptr && (bp > p || bp < p->s.ptr))
-            break;
-    if(bp + bp->s.size == p->s.ptr) {
-        bp->s.size += p->s.ptr->s.size;
-        bp->s.ptr = p->s.ptr->s.ptr;
-    } else
-        bp->s.ptr = p->s.ptr;
-    if(p + p->s.size == bp) {
-        p->s.size += bp->s.size;
-        p->s.ptr = bp->s.ptr;
-    } else
-        p->s.ptr = bp;
-    freep = p;
+static struct page *partial[NCLASS];
+static struct run *freeruns;
+
+static struct page* pageof(void *ap) {
+    return (struct page*)((uint)ap & ~(PAGESIZE-1));
+}
+
+static int classof(uint nbytes) {
+    int c;
+
+    for(c = 0; (1 << (c + MINSHIFT)) < nbytes; c++)
+        ;
+    return c;
+}
+
+static uint capacity(int c) {
+    return (PAGESIZE - HDRSIZE) >> (c + MINSHIFT);
+}
+
+// Return a run of npages pages to the free run list, merging it
+// with its neighbours, and give it back to the kernel if it now
+// sits at the top of the heap.
+static void putpages(void *v, uint npages) {
+    struct run *r, *p, *prev;
+
+    r = (struct run*)v;
+    r->npages = npages;
+    prev = 0;
+    for(p = freeruns; p && p < r; prev = p, p = p->next)
+        ;
+    r->next = p;
+    if(prev)
+        prev->next = r;
+    else
+        freeruns = r;
+
+    // Merge with the following run, then with the preceding one.
+    if(p && (char*)r + r->npages*PAGESIZE == (char*)p) {
+        r->npages += p->npages;
+        r->next = p->next;
+    }
+    if(prev && (char*)prev + prev->npages*PAGESIZE == (char*)r) {
+        prev->npages += r->npages;
+        prev->next = r->next;
+        r = prev;
+    }
+
+    // Trim the top of the heap.
+    if(r->next == 0 && (char*)r + r->npages*PAGESIZE == sbrk(0)) {
+        if(r == freeruns)
+            freeruns = 0;
+        else {
+            for(p = freeruns; p->next != r; p = p->next)
+                ;
+            p->next = 0;
+        }
+        sbrk(-(int)(r->npages*PAGESIZE));
+    }
 }
 
-static Header* morecore(uint nu) {
+// Allocate a run of npages contiguous, page-aligned pages.
+static void* getpages(uint npages) {
+    struct run *r, **pp;
     char *p;
-    Header *hp;
+    uint pad;
+
+    for(pp = &freeruns; (r = *pp) != 0; pp = &r->next) {
+        if(r->npages == npages) {
+            *pp = r->next;
+            return r;
+        }
+        if(r->npages > npages) {
+            r->npages -= npages;
+            return (char*)r + r->npages*PAGESIZE;
+        }
+    }
 
-    if(nu < 4096)
-        nu = 4096;
-    p = sbrk(nu * sizeof(Header));
+    // Keep the break page aligned so that every block header
+    // can be found by rounding down.
+    p = sbrk(0);
+    pad = -(uint)p & (PAGESIZE-1);
+    if(pad && sbrk(pad) == (char*)-1)
+        return 0;
+    p = sbrk(npages*PAGESIZE);
     if(p == (char*)-1)
         return 0;
-    hp = (Header*)p;
-    hp->s.size = nu;
-    free((void*)(hp + 1));
-    return freep;
+    return p;
 }
 
-void* malloc(uint nbytes) {
-    Header *p, *prevp;
-    uint nunits;
+static void* smallalloc(int c) {
+    struct page *pg;
+    char *obj;
+    uint i, size;
 
-    nunits = (nbytes + sizeof(Header) - 1)/sizeof(Header) + 1;
-    if((prevp = freep) == 0) {
-        base.s.ptr = freep = prevp = &base;
-        base.s.size = 0;
-    }
-    for(p = prevp->s.ptr;; prevp = p, p = p->s.ptr) {
-        if(p->s.size >= nunits) {
-            if(p->s.size == nunits)
-                prevp->s.ptr = p->s.ptr;
-            else {
-                p->s.size -= nunits;
-                p += p->s.size;
-                p->s.size = nunits;
-            }
-            freep = prevp;
-            return (void*)(p + 1);
+    if((pg = partial[c]) == 0) {
+        if((pg = getpages(1)) == 0)
+            return 0;
+        size = 1 << (c + MINSHIFT);
+        pg->class = c;
+        pg->nfree = capacity(c);
+        pg->u.s.free = 0;
+        for(i = pg->nfree; i > 0; i--) {
+            obj = (char*)pg + HDRSIZE + (i-1)*size;
+            *(void**)obj = pg->u.s.free;
+            pg->u.s.free = obj;
         }
-        if(p == freep)
-            if((p = morecore(nunits)) == 0)
-                return 0;
+        pg->u.s.prev = 0;
+        pg->u.s.next = 0;
+        partial[c] = pg;
     }
+
+    obj = pg->u.s.free;
+    pg->u.s.free = *(void**)obj;
+    if(--pg->nfree == 0) {
+        partial[c] = pg->u.s.next;
+        if(partial[c])
+            partial[c]->u.s.prev = 0;
+    }
+    return obj;
+}
+
+static void smallfree(struct page *pg, void *ap) {
+    int c = pg->class;
+
+    *(void**)ap = pg->u.s.free;
+    pg->u.s.free = ap;
+
+    if(++pg->nfree == 1) {
+        // Was full; make it available again.
+        pg->u.s.prev = 0;
+        pg->u.s.next = partial[c];
+        if(partial[c])
+            partial[c]->u.s.prev = pg;
+        partial[c] = pg;
+    } else if(pg->nfree == capacity(c) && (pg->u.s.prev || pg->u.s.next)) {
+        // Completely free and not the class's only page: release it.
+        if(pg->u.s.prev)
+            pg->u.s.prev->u.s.next = pg->u.s.next;
+        else
+            partial[c] = pg->u.s.next;
+        if(pg->u.s.next)
+            pg->u.s.next->u.s.prev = pg->u.s.prev;
+        putpages(pg, 1);
+    }
+}
+
+void free(void *ap) {
+    struct page *pg;
+
+    if(ap == 0)
+        return;
+    pg = pageof(ap);
+    if(pg->class == LARGE)
+        putpages(pg, pg->u.npages);
+    else
+        smallfree(pg, ap);
+}
+
+void* malloc(uint nbytes) {
+    struct page *pg;
+    uint npages;
+
+    if(nbytes <= MAXSMALL)
+        return smallalloc(classof(nbytes));
+
+    // npages*PAGESIZE must fit in sbrk()'s int argument.
+    if(nbytes >= 0x7fffffff - HDRSIZE - PAGESIZE)
+        return 0;
+    npages = (nbytes + HDRSIZE + PAGESIZE - 1) / PAGESIZE;
+    if((pg = getpages(npages)) == 0)
+        return 0;
+    pg->class = LARGE;
+    pg->nfree = 0;
+    pg->u.npages = npages;
+    return (char*)pg + HDRSIZE;
+}
+
+// Usable size of the block at ap.
+static uint blocksize(void *ap) {
+    struct page *pg = pageof(ap);
+
+    if(pg->class == LARGE)
+        return pg->u.npages*PAGESIZE - HDRSIZE;
+    return 1 << (pg->class + MINSHIFT);
+}
+
+void* realloc(void *ap, uint nbytes) {
+    void *np;
+    uint osize;
+
+    if(ap == 0)
+        return malloc(nbytes);
+    if(nbytes == 0) {
+        free(ap);
+        return 0;
+    }
+    osize = blocksize(ap);
+    if(nbytes <= osize)
+        return ap;
+    if((np = malloc(nbytes)) == 0)
+        return 0;
+    memmove(np, ap, osize < nbytes ? osize : nbytes);
+    free(ap);
+    return np;
+}
+
+void* calloc(uint n, uint size) {
+    void *p;
+
+    if(size && n > 0xffffffff / size)
+        return 0;
+    if((p = malloc(n * size)) != 0)
+        memset(p, 0, n * size);
+    return p;
 }
@@ -2,6 +2,9 @@
 
 struct stat;
 struct rtcdate;
+struct ring;
+struct iovec;
+struct dirstat;
 
 // system calls
 int fork(void);
@@ -30,6 +33,18 @@ int getNumFreePages(void);
 int testwait(int*, int*, int*);
 int yield(void);
 void getpinfo(struct pstat*);
+int nanosleep(int);
+void* mmap(void*, uint, int, int, int, int);
+int munmap(void*, uint);
+int ringsetup(struct ring*);
+int ringenter(int);
+int pread(int, void*, int, int);
+int pwrite(int, const void*, int, int);
+int readv(int, const struct iovec*, int);
+int writev(int, const struct iovec*, int);
+int sendfile(int, int, int);
+int getdents(int, struct dirstat*, int, int);
+int fstatat(int, const char*, struct stat*);
 
 
 int nice(int);
@@ -48,5 +63,13 @@ uint strlen(const char*);
 void* memset(void*, int, uint);
 void* malloc(uint);
 void free(void*);
+void* realloc(void*, uint);
+void* calloc(uint, uint);
 int atoi(const char*);
 void print_proc_info(struct pstat*, int);
+
+// uvdso.c
+int vuptime(void);
+int vgetpid(void);
+int vgetNumFreePages(void);
+void vgetpinfo(struct pstat*);
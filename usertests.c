@@ -1487,6 +1487,33 @@ void sbrktest(void) {
     printf(stdout, "sbrk test OK\n");
 }
 
+// Shrink from a page table that was never made into one that
+// fork() shared, and check the pages freed come back zeroed.
+void sbrkshrink(void) {
+    char *oldbrk;
+    int i, pid;
+
+    oldbrk = sbrk(0);
+    if(sbrk(16*1024*1024 - (uint)oldbrk) == (char*)-1) {
+        printf(stdout, "sbrkshrink: sbrk failed\n");
+        exit();
+    }
+    for(i = 8*1024*1024; i < 16*1024*1024; i += 4096)
+        *(char*)i = 1;
+    pid = fork();
+    sbrk(4*1024*1024 + 8192 - (uint)sbrk(0));
+    sbrk(16*1024*1024 - (uint)sbrk(0));
+    if(*(char*)(8*1024*1024) != 0) {
+        printf(stdout, "sbrkshrink: freed page kept its data\n");
+        exit();
+    }
+    if(pid == 0)
+        exit();
+    wait();
+    sbrk(oldbrk - sbrk(0));
+    printf(stdout, "sbrkshrink ok\n");
+}
+
 void validateint(int *p) {
     int res;
     asm ("mov %%esp, %%ebx\n\t"
@@ -1694,6 +1721,7 @@ int main(int argc, char *argv[]) {
     bigargtest();
     bsstest();
     sbrktest();
+    sbrkshrink();
     validatetest();
 
     opentest();
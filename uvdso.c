@@ -0,0 +1,47 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "x86.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "vdso.h"
+
+// System calls that only read kernel counters, answered from the
+// kernel data page instead (see vdso.h). Kept out of ulib.o so
+// that only programs that use them pay for them; link uvdso.o.
+
+int vuptime(void) {
+    return VDATA->ticks;
+}
+
+// Whatever this CPU last switched to is us, if we are still on
+// the same CPU and it has not switched since.
+int vgetpid(void) {
+    uint c, seq;
+    int pid;
+
+    do {
+        c = lsl((SEG_UCPU << 3) | DPL_USER);
+        seq = VDATA->cpu[c].seq;
+        __sync_synchronize();
+        pid = VDATA->cpu[c].pid;
+        __sync_synchronize();
+    } while(lsl((SEG_UCPU << 3) | DPL_USER) != c || VDATA->cpu[c].seq != seq);
+    return pid;
+}
+
+int vgetNumFreePages(void) {
+    return VDATA->nfree;
+}
+
+void vgetpinfo(struct pstat *ps) {
+    uint seq;
+
+    do {
+        while((seq = VDATA->pseq) & 1)
+            ;
+        __sync_synchronize();
+        memmove(ps, (void*)&VDATA->pinfo, sizeof(*ps));
+        __sync_synchronize();
+    } while(VDATA->pseq != seq);
+}
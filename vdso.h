@@ -0,0 +1,32 @@
+// Kernel data page, mapped read-only into every process at
+// VDSOBASE (see memlayout.h and vdsoinit in vm.c), so that user
+// code can read a few kernel counters without a system call.
+
+#include "pstat.h"
+
+// What one CPU is running. switchuvm() bumps seq before it
+// changes pid, so a reader that finds seq the same before and
+// after, and is on the same CPU after, has its own pid.
+struct vcpu {
+    uint seq;
+    int pid;
+};
+
+// One page, shared by every process. The timer interrupt on
+// CPU 0 rewrites the counters every tick. seq is odd while it
+// does, so a reader of more than one field copies them out and
+// tries again if seq was odd or changed in the meantime. pseq
+// does the same for pinfo, which changes only with the process
+// table (see setstate in proc.c).
+struct vdata {
+    uint seq;
+    uint ticks;             // what uptime() returns
+    uint64 tsc;             // time-stamp counter at the last tick
+    uint tscpertick;        // TSC calibration: cycles per tick
+    uint nfree;             // what getNumFreePages() returns
+    uint pseq;
+    struct pstat pinfo;     // what getpinfo() returns
+    struct vcpu cpu[NCPU];  // indexed by the SEG_UCPU limit
+};
+
+#define VDATA ((volatile struct vdata*)VDSOBASE)
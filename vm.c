@@ -6,16 +6,31 @@
 #include "mmu.h"
 #include "proc.h"
 #include "elf.h"
+#include "traps.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "mman.h"
+#include "vdso.h"
 
 
 extern char data[];  // defined by kernel.ld
+extern char sysentry[];  // trapasm.S
 pde_t *kpgdir;      // for use in scheduler()
+static int sysenterok;   // CPU has sysenter/sysexit
+struct vdata *vdata;     // the kernel data page (vdso.h)
+static pte_t *vdsopt;    // the page table that maps it
+
+// Swap slot held by a PTE with PTE_SWAP set (see swap.c).
+#define SWAPSLOT(pte) (PTE_ADDR(pte) >> PGSHIFT)
 
 
 // Set up CPU's kernel segment descriptors.
 // Run once on entry on each CPU.
 void seginit(void) {
     struct cpu *c;
+    uint eax, ebx, ecx, edx;
 
     // Map "logical" addresses to virtual addresses using identity map.
     // Cannot share a CODE descriptor for both kernel and user
@@ -31,9 +46,23 @@ void seginit(void) {
     // Map cpu and proc -- these are private per cpu.
     c->gdt[SEG_KCPU] = SEG(STA_W, &c->cpu, 8, 0);
 
+    // User code finds out which CPU it is on with lsl (see
+    // vgetpid in ulib.c).
+    c->gdt[SEG_UCPU] = SEG16(STA_W, 0, c - cpus, DPL_USER);
+
     lgdt(c->gdt, sizeof(c->gdt));
     loadgs(SEG_KCPU << 3);
 
+    // sysenter goes to sysentry, on the kernel stack of whatever
+    // process switchuvm() last loaded.
+    cpuinfo(1, &eax, &ebx, &ecx, &edx);
+    if(edx & CPUID_SEP) {
+        sysenterok = 1;
+        wrmsr(MSR_SYSENTER_CS, SEG_KCODE << 3);
+        wrmsr(MSR_SYSENTER_EIP, (uint)sysentry);
+        wrmsr(MSR_SYSENTER_ESP, 0);
+    }
+
     // Initialize cpu-local storage.
     c->cpu = c;
     c->proc = 0;
@@ -41,14 +70,22 @@ void seginit(void) {
 
 // Return the address of the PTE in page table pgdir
 // that corresponds to virtual address va.  If alloc!=0,
-// create any required page table pages.
+// create any required page table pages. There is no PTE
+// for an address in a 4 MB page; callers that can meet one
+// look at the PDE first.
 static pte_t* walkpgdir(pde_t *pgdir, const void *va, int alloc) {
     pde_t *pde;
     pte_t *pgtab;
 
     pde = &pgdir[PDX(va)];
 
-    if(*pde & PTE_P) {
+    if(*pde & PTE_PS) {
+        if(alloc)
+            panic("walkpgdir: 4 MB page");
+        return 0;
+    } else if(*pde & PTE_P) {
+        if(alloc && !(*pde & PTE_W))
+            panic("walkpgdir: shared page table");
         pgtab = (pte_t*)P2V(PTE_ADDR(*pde));
 
     } else {
@@ -93,20 +130,28 @@ static int mappages(pde_t *pgdir, void *va, uint size, uint pa, int perm) {
 // page protection bits prevent user code from using the kernel's
 // mappings.
 //
-// setupkvm() and exec() set up every page table like this:
+// kvmalloc() builds the kernel half of kpgdir once, at boot, and
+// setupkvm() gives every other page table the same kernel page
+// table pages by copying kpgdir's PDEs above KERNBASE. Only the
+// user half of a page table is ever freed. The kernel's mappings
+// use 4 MB pages (PTE_PS) wherever they can, which leaves most of
+// them with no page table page at all and takes far fewer TLB
+// entries; the first 4 MB, which hold the read-only kernel text,
+// use 4096-byte pages. Every page table looks like this:
 //
-//   0..KERNBASE: user memory (text+data+stack+heap), mapped to
+//   0..VDSOBASE: user memory (text+data+stack+heap), mapped to
 //                phys memory allocated by the kernel
+//   VDSOBASE..KERNBASE: read-only kernel data page (vdsoinit)
 //   KERNBASE..KERNBASE+EXTMEM: mapped to 0..EXTMEM (for I/O space)
 //   KERNBASE+EXTMEM..data: mapped to EXTMEM..V2P(data)
 //                for the kernel's instructions and r/o data
-//   data..KERNBASE+PHYSTOP: mapped to V2P(data)..PHYSTOP,
+//   data..KERNBASE+phystop: mapped to V2P(data)..phystop,
 //                                  rw data + free physical memory
 //   0xfe000000..0: mapped direct (devices such as ioapic)
 //
 // The kernel allocates physical memory for its heap and for user memory
-// between V2P(end) and the end of physical memory (PHYSTOP)
-// (directly addressable from end..P2V(PHYSTOP)).
+// between V2P(end) and the end of physical memory (phystop, found
+// at boot by kinit1) (directly addressable from end..P2V(phystop)).
 
 // This table defines the kernel's mappings, which are present in
 // every process's page table.
@@ -118,46 +163,85 @@ static struct kmap {
 } kmap[] = {
     { (void*)KERNBASE, 0,             EXTMEM,    PTE_W},// I/O space
     { (void*)KERNLINK, V2P(KERNLINK), V2P(data), 0},  // kern text+rodata
-    { (void*)data,     V2P(data),     PHYSTOP,   PTE_W},// kern data+memory
+    { (void*)data,     V2P(data),     0,         PTE_W},// kern data+memory
     { (void*)DEVSPACE, DEVSPACE,      0,         PTE_W},// more devices
 };
 
-// Set up kernel part of a page table.
+// Map [va, va+size) to [pa, pa+size) in pgdir, with 4 MB pages
+// wherever va and pa are both 4 MB aligned.
+static int kmappages(pde_t *pgdir, uint va, uint size, uint pa, int perm) {
+    uint n;
+
+    for(; size > 0; va += n, pa += n, size -= n) {
+        if(va % HPGSIZE == 0 && pa % HPGSIZE == 0 && size >= HPGSIZE) {
+            n = HPGSIZE;
+            pgdir[PDX(va)] = pa | perm | PTE_P | PTE_PS;
+            continue;
+        }
+        // 4096-byte pages up to the next 4 MB boundary.
+        n = HPGSIZE - va % HPGSIZE;
+        if(n > size)
+            n = size;
+        if(mappages(pgdir, (void*)va, n, pa, perm) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+// Set up kernel part of a page table, sharing kpgdir's kernel
+// page table pages, and map the kernel data page through the
+// page table everybody shares. Like a page table shared since
+// fork(), its PDE lacks PTE_W and it holds a reference for each
+// page directory, which deallocuvm() drops.
 pde_t* setupkvm(void) {
     pde_t *pgdir;
-    struct kmap *k;
 
     if((pgdir = (pde_t*)kalloc()) == 0)
         return 0;
 
-    memset(pgdir, 0, PGSIZE);
-
-    if (P2V(PHYSTOP) > (void*)DEVSPACE)
-        panic("PHYSTOP too high");
-
-    for(k = kmap; k < &kmap[NELEM(kmap)]; k++)
-        if(mappages(pgdir, k->virt, k->phys_end - k->phys_start, (uint)k->phys_start, k->perm) < 0) {
-            freevm(pgdir);
-            return 0;
-        }
+    memset(pgdir, 0, PDX(KERNBASE) * sizeof(pde_t));
+    memmove(&pgdir[PDX(KERNBASE)], &kpgdir[PDX(KERNBASE)],
+            (NPDENTRIES - PDX(KERNBASE)) * sizeof(pde_t));
+    pgdir[PDX(VDSOBASE)] = V2P(vdsopt) | PTE_P | PTE_U;
+    incrementReferenceCount(V2P(vdsopt));
     return pgdir;
 }
 
 // Allocate one page table for the machine for the kernel address
-// space for scheduler processes.
+// space for scheduler processes, and build the kernel mappings
+// that every page table shares.
 void kvmalloc(void) {
-    kpgdir = setupkvm();
-    switchkvm();
+    struct kmap *k;
+
+    if((kpgdir = (pde_t*)kalloc()) == 0)
+        panic("kvmalloc");
+
+    memset(kpgdir, 0, PGSIZE);
+
+    // The end of memory is only known at run time.
+    kmap[2].phys_end = phystop;
+    if (P2V(phystop) > (void*)DEVSPACE)
+        panic("phystop too high");
+
+    for(k = kmap; k < &kmap[NELEM(kmap)]; k++)
+        if(kmappages(kpgdir, (uint)k->virt, k->phys_end - k->phys_start, k->phys_start, k->perm) < 0)
+            panic("kvmalloc");
+    lcr3(V2P(kpgdir));
 }
 
 // Switch h/w page table register to the kernel-only page table,
 // for when no process is running.
 void switchkvm(void) {
+    pushcli();
+    mycpu()->pgdir = kpgdir;
     lcr3(V2P(kpgdir)); // switch to the kernel page table
+    popcli();
 }
 
 // Switch TSS and h/w page table to correspond to process p.
 void switchuvm(struct proc *p) {
+    struct vcpu *vc;
+
     if(p == 0)
         panic("switchuvm: no process");
     if(p->kstack == 0)
@@ -175,9 +259,18 @@ void switchuvm(struct proc *p) {
     // forbids I/O instructions (e.g., inb and outb) from user space
     mycpu()->ts.iomb = (ushort) 0xFFFF;
     ltr(SEG_TSS << 3);
+    if(sysenterok)
+        wrmsr(MSR_SYSENTER_ESP, (uint)p->kstack + KSTACKSIZE);
     if(p->pgdir == 0)
         panic("switchuvm: no pgdir");
+    mycpu()->pgdir = p->pgdir;
     lcr3(V2P(p->pgdir)); // switch to process's address space
+
+    // For vgetpid(); see vdso.h.
+    vc = &vdata->cpu[mycpu() - cpus];
+    vc->seq++;
+    __sync_synchronize();
+    vc->pid = p->pid;
     popcli();
 }
 
@@ -195,32 +288,6 @@ void inituvm(pde_t *pgdir, char *init, uint sz) {
     memmove(mem, init, sz);
 }
 
-// Load a program segment into pgdir.  addr must be page-aligned
-// and the pages from addr to addr+sz must already be mapped.
-int loaduvm(pde_t *pgdir, char *addr, struct inode *ip, uint offset, uint sz) {
-    uint i, pa, n;
-    pte_t *pte;
-
-    if((uint)addr % PGSIZE != 0)
-        panic("loaduvm: addr must be page aligned");
-
-    for(i = 0; i < sz; i += PGSIZE) {
-        if((pte = walkpgdir(pgdir, addr+i, 0)) == 0)
-            panic("loaduvm: address should exist");
-
-        pa = PTE_ADDR(*pte);
-
-        if(sz - i < PGSIZE)
-            n = sz - i;
-        else
-            n = PGSIZE;
-
-        if(readi(ip, P2V(pa), offset+i, n) != n)
-            return -1;
-    }
-    return 0;
-}
-
 // Allocate page tables and physical memory to grow process from oldsz to
 // newsz, which need not be page aligned.  Returns new size or 0 on error.
 int allocuvm(pde_t *pgdir, uint oldsz, uint newsz) {
@@ -256,6 +323,22 @@ int allocuvm(pde_t *pgdir, uint oldsz, uint newsz) {
     return newsz;
 }
 
+// Drop a reference to the page table page pgtab, freeing it and
+// the pages it maps along with the last one.
+static void ptput(pte_t *pgtab) {
+    int i;
+
+    if(decrementReferenceCount(V2P(pgtab)) > 0)
+        return;
+    for(i = 0; i < NPTENTRIES; i++) {
+        if(pgtab[i] & PTE_P)
+            kfree(P2V(PTE_ADDR(pgtab[i])));
+        else if(pgtab[i] & PTE_SWAP)
+            swapfree(SWAPSLOT(pgtab[i]));
+    }
+    kfree((char*)pgtab);
+}
+
 // Deallocate user pages to bring the process size from oldsz to
 // newsz.  oldsz and newsz need not be page-aligned, nor does newsz
 // need to be less than oldsz.  oldsz can be larger than the actual
@@ -270,11 +353,30 @@ int deallocuvm(pde_t *pgdir, uint oldsz, uint newsz) {
     a = PGROUNDUP(newsz);
 
     for(; a  < oldsz; a += PGSIZE) {
+        if(pgdir[PDX(a)] & PTE_PS) {
+            // A MAP_HUGE page; munmap() only removes whole ones.
+            kfree(P2V(PTE_ADDR(pgdir[PDX(a)])));
+            pgdir[PDX(a)] = 0;
+            a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
+            continue;
+        }
+
+        if((pgdir[PDX(a)] & (PTE_P|PTE_W)) == PTE_P) {
+            // A page table shared since fork(); callers unshare
+            // those only partly in the range (uvmunshare).
+            if(a % HPGSIZE || a + HPGSIZE > oldsz)
+                panic("deallocuvm: shared page table");
+            ptput((pte_t*)P2V(PTE_ADDR(pgdir[PDX(a)])));
+            pgdir[PDX(a)] = 0;
+            a += HPGSIZE - PGSIZE;
+            continue;
+        }
+
         pte = walkpgdir(pgdir, (char*)a, 0);
 
         if(!pte)
-            // Changes here
-            a += (NPTENTRIES - 1) * PGSIZE;
+            // No page table: go on at the next one.
+            a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
 
         else if((*pte & PTE_P) != 0) {
             pa = PTE_ADDR(*pte);
@@ -285,13 +387,16 @@ int deallocuvm(pde_t *pgdir, uint oldsz, uint newsz) {
             char *v = P2V(pa);
             kfree(v);
             *pte = 0;
+        } else if(*pte & PTE_SWAP) {
+            swapfree(SWAPSLOT(*pte));
+            *pte = 0;
         }
     }
     return newsz;
 }
 
 // Free a page table and all the physical memory pages
-// in the user part.
+// in the user part. The kernel part belongs to kpgdir.
 void freevm(pde_t *pgdir) {
     uint i;
 
@@ -300,7 +405,7 @@ void freevm(pde_t *pgdir) {
 
     deallocuvm(pgdir, KERNBASE, 0);
 
-    for(i = 0; i < NPDENTRIES; i++) {
+    for(i = 0; i < PDX(KERNBASE); i++) {
 
         if(pgdir[i] & PTE_P) {
             char * v = P2V(PTE_ADDR(pgdir[i]));
@@ -324,6 +429,98 @@ void clearpteu(pde_t *pgdir, char *uva) {
     *pte &= ~PTE_U; // Current page has write permissions enabled
 }
 
+//PAGEBREAK!
+// TLB maintenance.
+//
+// Changing or removing a present PTE must invalidate its stale
+// TLB entry, on this CPU and on every other CPU that has the page
+// table loaded (c->pgdir). A single page is invalidated with
+// invlpg, rather than by reloading %cr3 and losing the whole TLB.
+// Other CPUs are asked to do the same with a T_TLBFLUSH IPI,
+// through a one-entry mailbox in their struct cpu, and the sender
+// waits until they have. While it waits for a mailbox or an
+// answer, a CPU carries out requests sent to itself, so that two
+// CPUs shooting at each other with interrupts off can't deadlock.
+
+#define TLBALL    0xffffffff    // tlbva: flush the whole TLB
+#define TLBBATCH  32            // more pages than this: flush it all
+
+static void tlblocal(uint va) {
+    if(va == TLBALL)
+        lcr3(rcr3());
+    else
+        invlpg((void*)va);
+}
+
+// Carry out a shootdown request sent to this CPU, if any.
+void tlbintr(void) {
+    struct cpu *c = mycpu();
+
+    if(c->tlbpending) {
+        tlblocal(c->tlbva);
+        c->tlbpending = 0;
+    }
+}
+
+static void tlbshoot(pde_t *pgdir, uint va) {
+    struct cpu *me, *c;
+
+    pushcli();
+    me = mycpu();
+    if(me->pgdir == pgdir)
+        tlblocal(va);
+
+    // Make the PTE change visible before looking at which page
+    // tables the other CPUs have loaded.
+    __sync_synchronize();
+    for(c = cpus; c < cpus+ncpu; c++) {
+        if(c == me || c->pgdir != pgdir)
+            continue;
+        while(xchg(&c->tlbbusy, 1) != 0)
+            tlbintr();
+        c->tlbva = va;
+        c->tlbpending = 1;
+        lapicipi(c->apicid, T_TLBFLUSH);
+        while(c->tlbpending)
+            tlbintr();
+        xchg(&c->tlbbusy, 0);
+    }
+    popcli();
+}
+
+// Invalidate the TLB entries for va in pgdir.
+void tlbinval(pde_t *pgdir, uint va) {
+    tlbshoot(pgdir, PGROUNDDOWN(va));
+}
+
+// Invalidate all TLB entries for pgdir.
+void tlbflush(pde_t *pgdir) {
+    tlbshoot(pgdir, TLBALL);
+}
+
+// Write-protect pte, for va in pgdir, for copy-on-write. The
+// first TLBBATCH of these are invalidated one at a time; *n
+// counts them, and past that the caller flushes the whole TLB.
+static void cowprotect(pde_t *pgdir, pte_t *pte, uint va, int *n) {
+    if(!(*pte & PTE_W))
+        return;
+    *pte &= ~PTE_W;
+    if(++*n <= TLBBATCH)
+        tlbinval(pgdir, va);
+}
+
+// Give page table d the swapped-out page pte at va, sharing its
+// swap slot.
+static int copyswap(pde_t *d, uint va, pte_t pte) {
+    pte_t *dpte;
+
+    if((dpte = walkpgdir(d, (char*)va, 1)) == 0)
+        return -1;
+    swapdup(SWAPSLOT(pte));
+    *dpte = pte;
+    return 0;
+}
+
 pde_t* copyuvm_original(pde_t *pgdir, uint sz) {
     pde_t *d;
     pte_t *pte;
@@ -335,11 +532,18 @@ pde_t* copyuvm_original(pde_t *pgdir, uint sz) {
 
     for(i = 0; i < sz; i += PGSIZE) {
 
-        if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0)
-            panic("copyuvm: pte should exist");
+        // Pages that have not been faulted in yet stay
+        // that way in the child.
+        if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0) {
+            i = PGADDR(PDX(i) + 1, 0, 0) - PGSIZE;
+            continue;
+        }
 
-        if(!(*pte & PTE_P))
-            panic("copyuvm: page not present");
+        if(!(*pte & PTE_P)) {
+            if((*pte & PTE_SWAP) && copyswap(d, i, *pte) < 0)
+                goto bad;
+            continue;
+        }
 
         pa = PTE_ADDR(*pte);
         flags = PTE_FLAGS(*pte);
@@ -361,54 +565,112 @@ bad:
     return 0;
 }
 
-// Given a parent process's page table, create a copy
-// of it for a child.
-pde_t* copyuvm(pde_t *pgdir, uint sz) {
-    pde_t *d;
-    pte_t *pte;
-    uint pa, i, flags;
+static struct vma* findvma(struct proc*, uint);
+
+// Copy-on-write fork.
+//
+// fork() copies no page tables. The child's page directory gets
+// the parent's PDEs, and parent and child share every user page
+// table page, which is reference counted like any other page.
+// A page table page holds one reference to each page (or swap
+// slot) it maps, however many page directories point at it.
+// Both PDEs are write-protected, which makes everything below
+// them read-only, so fork() takes time in proportion to the
+// page directory, not to the size of the process.
+//
+// Any change to the PTEs of a shared page table first gives the
+// process a private copy of it (ptunshare). The copy takes a
+// reference to each page; those pages are now shared, so the
+// copy and the original both lose PTE_W, and writes to them go
+// on to the usual per-page copy-on-write in pagefault(). Pages
+// of MAP_SHARED regions stay writable in both. The last process
+// left with a write-protected page table just gets PTE_W back.
+
+// Given parent process p, create a copy of its page table for
+// a child. The child keeps the kernel data page setupkvm()
+// gave it.
+pde_t* copyuvm(struct proc *p) {
+    pde_t *d, *pgdir;
+    struct vma *v;
+    uint i;
 
     if((d = setupkvm()) == 0)
         return 0;
 
-    for(i = 0; i < sz; i += PGSIZE) {
-
-        if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0)
-            panic("copyuvm: pte should exist");
+    pgdir = p->pgdir;
+    for(i = 0; i < PDX(VDSOBASE); i++) {
+        if(!(pgdir[i] & PTE_P))
+            continue;
+        // MAP_SHARED 4 MB pages are the one thing left writable.
+        v = findvma(p, PGADDR(i, 0, 0));
+        if(!(pgdir[i] & PTE_PS) || v == 0 || !(v->flags & MAP_SHARED))
+            pgdir[i] &= ~PTE_W;
+        d[i] = pgdir[i] & ~PTE_D;
+        incrementReferenceCount(PTE_ADDR(pgdir[i]));
+    }
+    tlbflush(pgdir);
+    return d;
+}
 
-        if(!(*pte & PTE_P))
-            panic("copyuvm: page not present");
+// If p shares the page table for va, give it a private copy.
+// Returns 0, or -1 if out of memory.
+static int ptunshare(struct proc *p, uint va) {
+    pde_t *pde;
+    pte_t *old, *new;
+    struct vma *v;
+    uint a;
+    int i;
 
-        *pte &= ~PTE_W;                  // make the permissions for the parent_page read only
-        pa = PTE_ADDR(*pte);
-        flags = PTE_FLAGS(*pte);
+    pde = &p->pgdir[PDX(va)];
+    if((*pde & (PTE_P|PTE_W|PTE_PS)) != PTE_P)
+        return 0;
+    old = (pte_t*)P2V(PTE_ADDR(*pde));
+    if(getReferenceCount(V2P(old)) == 1) {
+        *pde |= PTE_W;
+        tlbflush(p->pgdir);
+        return 0;
+    }
 
-        if(mappages(d, (void*)i, PGSIZE, pa, flags) < 0) {
-            goto bad;
+    if((new = (pte_t*)kalloc()) == 0)
+        return -1;
+    for(i = 0; i < NPTENTRIES; i++) {
+        if(old[i] & PTE_P) {
+            a = PGADDR(PDX(va), i, 0);
+            if((v = findvma(p, a)) != 0 && (v->flags & MAP_SHARED))
+                new[i] = old[i] & ~PTE_D;
+            else {
+                old[i] &= ~PTE_W;
+                new[i] = old[i];
+            }
+            incrementReferenceCount(PTE_ADDR(old[i]));
+        } else {
+            if(old[i] & PTE_SWAP)
+                swapdup(SWAPSLOT(old[i]));
+            new[i] = old[i];
         }
-
-        incrementReferenceCount(pa);
     }
-
-    lcr3(V2P(pgdir));
-    return d;
-
-bad:
-    freevm(d);
-
-    // Flush the TLB
-    lcr3(V2P(pgdir));
+    *pde = V2P(new) | PTE_P | PTE_W | PTE_U;
+    ptput(old);
+    tlbflush(p->pgdir);
     return 0;
 }
 
 //PAGEBREAK!
 // Map user virtual address to kernel address.
 char* uva2ka(pde_t *pgdir, char *uva) {
+    pde_t *pde;
     pte_t *pte;
 
+    pde = &pgdir[PDX(uva)];
+    if(*pde & PTE_PS) {
+        if((*pde & PTE_U) == 0)
+            return 0;
+        return (char*)P2V(PTE_ADDR(*pde) + ((uint)uva & (HPGSIZE-1) & ~(PGSIZE-1)));
+    }
+
     pte = walkpgdir(pgdir, uva, 0);
 
-    if((*pte & PTE_P) == 0)
+    if(pte == 0 || (*pte & PTE_P) == 0)
         return 0;
 
     if((*pte & PTE_U) == 0)
@@ -447,55 +709,643 @@ int copyout(pde_t *pgdir, uint va, void *p, uint len) {
 }
 
 //PAGEBREAK!
-// Blank page.
-//PAGEBREAK!
-// Blank page.
-//PAGEBREAK!
-// Blank page.
+// Demand paging.
+//
+// exec() does not read a program into memory. It records each
+// loadable segment as a struct vma, and the first touch of a
+// page in it faults into vmafill(), which allocates the page and
+// reads it from the program's inode (or leaves it zeroed, for
+// bss). copyuvm() leaves unfilled pages unfilled in the child.
+// Pages that hold nothing but file data are mapped from the page
+// cache (itext in fs.c) and so shared with everyone else running
+// the program. The page the file data ends in is copied out of
+// the page cache by readi().
+//
+// Filling a page may sleep in readi(), which is fine from a user
+// page fault but not from kernel code that touches user memory
+// while holding a spinlock (e.g. piperead) or the inode being
+// read. So argptr(), argout() and fetchstr() fill in the memory
+// they hand to system calls with uvmprefault() before any locks
+// are taken.
+
+static struct vma* findvma(struct proc *p, uint va) {
+    struct vma *v;
+
+    for(v = p->vma; v < &p->vma[NVMA]; v++)
+        if(v->end && v->start <= va && va < v->end)
+            return v;
+    return 0;
+}
 
-void pagefault(uint err_code) {
+// Fill in the page at va from p's vmas. Returns 0, -1 if va
+// is not in any of them, or -2 if out of memory.
+static int vmafill(struct proc *p, uint va) {
+    struct vma *v;
+    char *mem;
+    uint a, n, off;
+    int perm, shared;
+
+    if((v = findvma(p, va)) == 0)
+        return -1;
+    if(v->flags == 0 && va >= p->sz)
+        return -1;
+    if(p->pgdir[PDX(va)] & PTE_PS)
+        return 0;
 
-    // get the faulting virtual address from the CR2 register
-    uint va = rcr2();
+    a = PGROUNDDOWN(va);
+    off = v->off + (a - v->start);
+    perm = PTE_U;
+    if(v->flags == 0 || (v->prot & PROT_WRITE))
+        perm |= PTE_W;
+    shared = v->ip && (v->flags & MAP_SHARED);
+
+    // MAP_HUGE: a whole 4 MB page, if the pool has one left and
+    // no 4096-byte page of this 4 MB has been filled in yet.
+    a = HPGROUNDDOWN(va);
+    if((v->flags & MAP_HUGE) && a >= v->start && a + HPGSIZE <= v->end &&
+       !(p->pgdir[PDX(a)] & PTE_P) && (mem = hugealloc()) != 0) {
+        memset(mem, 0, HPGSIZE);
+        p->pgdir[PDX(a)] = V2P(mem) | perm | PTE_P | PTE_PS;
+        return 0;
+    }
+    a = PGROUNDDOWN(va);
+
+    // A page made up entirely of file data is mapped straight
+    // from the page cache, read-only, so a write gets a private
+    // copy. MAP_SHARED mappings, which mmap() keeps page-aligned,
+    // map the same frames writable.
+    if(v->ip && (shared || a - v->start + PGSIZE <= v->filesz)) {
+        ilock(v->ip);
+        mem = itext(v->ip, off);
+        iunlock(v->ip);
+        if(mem == 0)
+            return -2;
+        if(!shared)
+            perm &= ~PTE_W;
+    } else {
+        if((mem = kalloc()) == 0)
+            return -2;
+        memset(mem, 0, PGSIZE);
+        if(v->ip && a - v->start < v->filesz) {
+            n = v->filesz - (a - v->start);
+            if(n > PGSIZE)
+                n = PGSIZE;
+            ilock(v->ip);
+            if(readi(v->ip, mem, off, n) != n) {
+                iunlock(v->ip);
+                kfree(mem);
+                return -2;
+            }
+            iunlock(v->ip);
+        }
+    }
+    if(mappages(p->pgdir, (char*)a, PGSIZE, V2P(mem), perm) < 0) {
+        kfree(mem);
+        return -2;
+    }
+    return 0;
+}
+
+// Read the swapped-out page at va back in. Returns 0, or -2
+// if out of memory.
+static int swapin(struct proc *p, uint va) {
     pte_t *pte;
+    char *mem;
+    uint s;
+
+    if((mem = kalloc()) == 0)
+        return -2;
+    pte = walkpgdir(p->pgdir, (char*)va, 0);
+    s = SWAPSLOT(*pte);
+    swapread(s, mem);
+    *pte = V2P(mem) | (PTE_FLAGS(*pte) & ~PTE_SWAP) | PTE_P;
+    swapfree(s);
+    return 0;
+}
 
-    // Error Handling for no user process
-    if(myproc() == 0) {
-        cprintf("Page fault with no user process from cpu %d, cr2=0x%x\n", mycpu()->apicid, va);
-        panic("pagefault");
+// Bring in the absent page at va, from swap or from its vma.
+static int pagein(struct proc *p, uint va) {
+    pte_t *pte;
+
+    if(ptunshare(p, va) < 0)
+        return -2;
+    pte = walkpgdir(p->pgdir, (char*)va, 0);
+    if(pte && (*pte & PTE_SWAP))
+        return swapin(p, va);
+    return vmafill(p, va);
+}
+
+// Advance p's clock hand (p->clockva) over its user pages,
+// clearing PTE_A on pages used since the hand last passed, up
+// to the first private page that has not been. That page's PTE
+// is replaced by one for swap slot s, and the page returned.
+// Returns 0, with the hand back at 0, at the end of the address
+// space. Pages of MAP_SHARED regions, 4 MB pages, shared page
+// tables and pages shared with anyone (including the page cache)
+// are left alone. Caller
+// holds ptable.lock, and p is not running.
+char* clockscan(struct proc *p, uint s) {
+    struct vma *v;
+    pde_t *pde;
+    pte_t *pte;
+    uint a, pa;
+
+    for(a = p->clockva; a < VDSOBASE; a += PGSIZE) {
+        pde = &p->pgdir[PDX(a)];
+        if(!(*pde & PTE_P) || (*pde & PTE_PS) ||
+           getReferenceCount(PTE_ADDR(*pde)) > 1) {
+            a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
+            continue;
+        }
+        pte = &((pte_t*)P2V(PTE_ADDR(*pde)))[PTX(a)];
+        if((*pte & (PTE_P|PTE_U)) != (PTE_P|PTE_U))
+            continue;
+        if(*pte & PTE_A) {
+            *pte &= ~PTE_A;
+            tlbinval(p->pgdir, a);
+            continue;
+        }
+        pa = PTE_ADDR(*pte);
+        if(getReferenceCount(pa) != 1)
+            continue;
+        if((v = findvma(p, a)) != 0 && (v->flags & MAP_SHARED))
+            continue;
+        *pte = (s << PGSHIFT) | (PTE_FLAGS(*pte) & ~PTE_P) | PTE_SWAP;
+        tlbinval(p->pgdir, a);
+        p->clockva = a + PGSIZE;
+        return P2V(pa);
     }
+    p->clockva = 0;
+    return 0;
+}
 
-    // Error handling for illegal virtual address
-    if(va >= KERNBASE || (pte = walkpgdir(myproc()->pgdir, (void*)va, 0)) == 0  ||
-       !(*pte & PTE_P) || !(*pte & PTE_U) ) {
-        cprintf("Illegal virtual address on cpu %d addr 0x%x, kill proc %s with pid %d\n",
-                mycpu()->apicid, va, myproc()->name, myproc()->pid);
-        // mark the process as killed
-        myproc()->killed = 1;
+// Is [va, va+len) user memory of the current process: either
+// below p->sz or inside one mmap() region?
+int uvmvalid(uint va, uint len) {
+    struct proc *p = myproc();
+    struct vma *v;
+
+    if(va + len < va)
+        return 0;
+    if(va + len <= p->sz)
+        return 1;
+    v = findvma(p, va);
+    return v && v->flags && va + len <= v->end;
+}
+
+// Give p its own copies of any page tables that [lo, hi) covers
+// only in part, so that deallocuvm() can free the range. Returns
+// 0, or -1 if out of memory.
+int uvmunshare(struct proc *p, uint lo, uint hi) {
+    if(lo >= hi)
+        return 0;
+    if(ptunshare(p, lo) < 0 || ptunshare(p, hi - 1) < 0)
+        return -1;
+    return 0;
+}
+
+static int vmfault(struct proc*, uint, int);
+
+// Can the kernel touch va in p's memory, for writing if write
+// is set, without a page fault?
+static int uvmmapped(struct proc *p, uint va, int write) {
+    pde_t pde;
+    pte_t *pte;
+
+    pde = p->pgdir[PDX(va)];
+    if(!(pde & PTE_P))
+        return 0;
+    if(pde & PTE_PS)
+        return !write || (pde & PTE_W);
+    pte = walkpgdir(p->pgdir, (char*)va, 0);
+    if(pte == 0 || !(*pte & PTE_P))
+        return 0;
+    return !write || ((pde & PTE_W) && (*pte & PTE_W));
+}
+
+// Make sure the user pages in [va, va+len) are present and, if
+// write is set, writable: a write to an mmap() region without
+// PROT_WRITE fails here, and pages shared since fork() are
+// copied now. The system call then never faults on them.
+int uvmprefault(uint va, uint len, int write) {
+    struct proc *p = myproc();
+    uint a;
+    int r;
+
+    for(a = PGROUNDDOWN(va); a < va + len; a += PGSIZE) {
+        while(!uvmmapped(p, a, write)) {
+            if((r = vmfault(p, a, write)) == -2 && swapwait())
+                continue;
+            if(r < 0)
+                return -1;
+        }
+    }
+    return 0;
+}
+
+// Extend p's memory from p->sz to newsz with zero-filled pages
+// that are only allocated when first touched. The heap grows by
+// stretching the zero-filled vma that ends at p->sz, if any.
+int vmagrow(struct proc *p, uint newsz) {
+    struct vma *v, *free;
+
+    free = 0;
+    for(v = p->vma; v < &p->vma[NVMA]; v++) {
+        if(v->end == 0 && free == 0)
+            free = v;
+        if(v->end && v->ip == 0 && v->end == p->sz) {
+            v->end = newsz;
+            return 0;
+        }
+    }
+    if(free == 0)
+        return -1;
+    memset(free, 0, sizeof(*free));
+    free->start = PGROUNDDOWN(p->sz);
+    free->end = newsz;
+    return 0;
+}
+
+// Cut p's vmas off at newsz, after deallocuvm() has freed the
+// pages above it. File-backed vmas keep their (possibly now
+// empty) slot so that the file reference is dropped by exec
+// or exit, inside a transaction.
+void vmashrink(struct proc *p, uint newsz) {
+    struct vma *v;
+
+    for(v = p->vma; v < &p->vma[NVMA]; v++) {
+        if(v->end == 0 || v->end <= newsz)
+            continue;
+        if(v->start >= newsz) {
+            if(v->ip == 0) {
+                v->start = v->end = 0;
+                continue;
+            }
+            v->end = v->start;
+        } else
+            v->end = newsz;
+    }
+}
+
+// Copy the vmas in src to dst, taking references to their files.
+void vmadup(struct vma *dst, struct vma *src) {
+    int i;
+
+    for(i = 0; i < NVMA; i++) {
+        dst[i] = src[i];
+        if(dst[i].ip)
+            idup(dst[i].ip);
+    }
+}
+
+// Release the vmas in vma. Must be called inside a
+// transaction, since it may iput() their files.
+void vmaclear(struct vma *vma) {
+    int i;
+
+    for(i = 0; i < NVMA; i++) {
+        if(vma[i].ip)
+            iput(vma[i].ip);
+        memset(&vma[i], 0, sizeof(vma[i]));
+    }
+}
+
+//PAGEBREAK!
+// mmap() regions.
+//
+// mmap() just records a vma above MMAPBASE; pages are filled in
+// by vmafill() like any other demand-paged memory. Anonymous and
+// MAP_PRIVATE file pages are private to the process (file pages
+// copy-on-write from the inode's page cache). MAP_SHARED file
+// pages are the page cache's frames themselves, and dirty ones
+// are written back to the file by munmap(), exit() and exec().
+// fork() gives the child the same frames for MAP_SHARED regions
+// and copy-on-write ones for MAP_PRIVATE regions.
+
+// Write n bytes at src to ip at off, a few blocks per
+// transaction (as in filewrite). Caller must not be in a
+// transaction.
+static void writeback(struct inode *ip, char *src, uint off, uint n) {
+    int max = ((MAXOPBLOCKS-1-1-2) / 2) * 512;
+    uint i, n1;
+
+    for(i = 0; i < n; i += n1) {
+        n1 = n - i;
+        if(n1 > max)
+            n1 = max;
+        begin_op();
+        ilock(ip);
+        writei(ip, src + i, off + i, n1);
+        iunlock(ip);
+        end_op();
+    }
+}
+
+// Write the dirty pages of v in [lo, hi) back to its file.
+static void vmasync1(struct proc *p, struct vma *v, uint lo, uint hi) {
+    pte_t *pte;
+    uint a, n;
+
+    if(v->ip == 0 || (v->flags & MAP_SHARED) == 0)
         return;
+    for(a = lo; a < hi && a - v->start < v->filesz; a += PGSIZE) {
+        pte = walkpgdir(p->pgdir, (char*)a, 0);
+        if(pte == 0 || (*pte & (PTE_P|PTE_D)) != (PTE_P|PTE_D))
+            continue;
+        n = v->filesz - (a - v->start);
+        if(n > PGSIZE)
+            n = PGSIZE;
+        *pte &= ~PTE_D;
+        tlbinval(p->pgdir, a);
+        writeback(v->ip, P2V(PTE_ADDR(*pte)), v->off + (a - v->start), n);
     }
+}
 
-    // Error current page has write permissions enabled
-    if(*pte & PTE_W) {
-        cprintf("error code: %x, addr 0x%x\n", err_code, va);
+// Write back all of p's shared file mappings.
+void vmasync(struct proc *p) {
+    struct vma *v;
+
+    for(v = p->vma; v < &p->vma[NVMA]; v++)
+        if(v->end && v->flags)
+            vmasync1(p, v, v->start, v->end);
+}
+
+// Map len bytes of f at off (or zeroes, for MAP_ANONYMOUS)
+// into the current process. Returns the address, or -1.
+uint mmap(uint len, int prot, int flags, struct file *f, uint off) {
+    struct proc *p = myproc();
+    struct vma *v, *free;
+    uint a, align;
+
+    if(len == 0 || len > VDSOBASE - MMAPBASE)
+        return -1;
+    if(((flags & MAP_SHARED) != 0) == ((flags & MAP_PRIVATE) != 0))
+        return -1;
+    // MAP_HUGE regions are whole, aligned 4 MB pages.
+    align = PGSIZE;
+    if(flags & MAP_HUGE) {
+        if(!(flags & MAP_ANONYMOUS))
+            return -1;
+        align = HPGSIZE;
+    }
+    len = (len + align - 1) & ~(align - 1);
+    if(!(flags & MAP_ANONYMOUS)) {
+        if(f == 0 || f->type != FD_INODE || !f->readable || off % PGSIZE)
+            return -1;
+        if((flags & MAP_SHARED) && (prot & PROT_WRITE) && !f->writable)
+            return -1;
+    }
+
+    for(free = p->vma; free < &p->vma[NVMA] && free->end; free++)
+        ;
+    if(free == &p->vma[NVMA])
+        return -1;
+
+    // First fit above MMAPBASE.
+    for(a = MMAPBASE; ; a = (v->end + align - 1) & ~(align - 1)) {
+        if(a + len > VDSOBASE || a + len < a)
+            return -1;
+        for(v = p->vma; v < &p->vma[NVMA]; v++)
+            if(v->end && v->flags && v->start < a + len && a < v->end)
+                break;
+        if(v == &p->vma[NVMA])
+            break;
+    }
+
+    memset(free, 0, sizeof(*free));
+    if(!(flags & MAP_ANONYMOUS)) {
+        free->ip = idup(f->ip);
+        ilock(f->ip);
+        if(f->ip->size > off)
+            free->filesz = f->ip->size - off < len ? f->ip->size - off : len;
+        iunlock(f->ip);
+        free->off = off;
+    }
+    free->prot = prot;
+    free->flags = flags;
+    free->start = a;
+    free->end = a + len;
+    return a;
+}
+
+// Unmap [addr, addr+len) from the current process, writing
+// back any shared file pages in it first. Only whole 4 MB pages
+// of a MAP_HUGE region can be unmapped.
+int munmap(uint addr, uint len) {
+    struct proc *p = myproc();
+    struct vma *v, *nv;
+    struct inode *ip;
+    uint end, lo, hi, d;
+
+    end = addr + PGROUNDUP(len);
+    if(addr % PGSIZE || len == 0 || end < addr || addr < MMAPBASE || end > VDSOBASE)
+        return -1;
+
+    for(v = p->vma; v < &p->vma[NVMA]; v++) {
+        if(v->end == 0 || v->flags == 0 || v->end <= addr || end <= v->start)
+            continue;
+        lo = addr > v->start ? addr : v->start;
+        hi = end < v->end ? end : v->end;
+        if((v->flags & MAP_HUGE) && (lo % HPGSIZE || hi % HPGSIZE))
+            return -1;
+
+        // A hole in the middle splits the region in two.
+        nv = 0;
+        if(v->start < lo && hi < v->end) {
+            for(nv = p->vma; nv < &p->vma[NVMA] && nv->end; nv++)
+                ;
+            if(nv == &p->vma[NVMA])
+                return -1;
+        }
+
+        if(uvmunshare(p, lo, hi) < 0)
+            return -1;
+        vmasync1(p, v, lo, hi);
+        deallocuvm(p->pgdir, hi, lo);
+
+        if(nv) {
+            *nv = *v;
+            d = hi - v->start;
+            nv->start = hi;
+            nv->off += d;
+            nv->filesz = nv->filesz > d ? nv->filesz - d : 0;
+            if(nv->ip)
+                idup(nv->ip);
+        }
+        if(lo == v->start && hi == v->end) {
+            ip = v->ip;
+            memset(v, 0, sizeof(*v));
+            if(ip) {
+                begin_op();
+                iput(ip);
+                end_op();
+            }
+        } else if(lo == v->start) {
+            d = hi - v->start;
+            v->start = hi;
+            v->off += d;
+            v->filesz = v->filesz > d ? v->filesz - d : 0;
+        } else {
+            v->end = lo;
+            if(v->filesz > lo - v->start)
+                v->filesz = lo - v->start;
+        }
+    }
+    tlbflush(p->pgdir);
+    return 0;
+}
+
+// Give child page table d the parent p's mmap() pages.
+int copymmap(pde_t *d, struct proc *p) {
+    struct vma *v;
+    pde_t *pde;
+    pte_t *pte;
+    uint a, pa;
+    int nwp;
+
+    nwp = 0;
+    for(v = p->vma; v < &p->vma[NVMA]; v++) {
+        if(v->end == 0 || v->flags == 0)
+            continue;
+        for(a = v->start; a < v->end; a += PGSIZE) {
+            pde = &p->pgdir[PDX(a)];
+            if(*pde & PTE_PS) {
+                if(v->flags & MAP_PRIVATE)
+                    cowprotect(p->pgdir, pde, a, &nwp);
+                d[PDX(a)] = *pde & ~PTE_D;
+                incrementReferenceCount(PTE_ADDR(*pde));
+                a += HPGSIZE - PGSIZE;
+                continue;
+            }
+            pte = walkpgdir(p->pgdir, (char*)a, 0);
+            if(pte && (*pte & PTE_SWAP) && copyswap(d, a, *pte) < 0)
+                return -1;
+            if(pte == 0 || !(*pte & PTE_P))
+                continue;
+            if(v->flags & MAP_PRIVATE)
+                cowprotect(p->pgdir, pte, a, &nwp);
+            pa = PTE_ADDR(*pte);
+            if(mappages(d, (char*)a, PGSIZE, pa, PTE_FLAGS(*pte) & ~PTE_D) < 0)
+                return -1;
+            incrementReferenceCount(pa);
+        }
+    }
+    if(nwp > TLBBATCH)
+        tlbflush(p->pgdir);
+    return 0;
+}
+
+// Out of memory in a page fault: wait for kswapd to free some,
+// after which the faulting instruction is retried. Returns 0 if
+// that is hopeless, or if we hold a spin-lock and cannot sleep.
+static int oomwait(uint err_code) {
+    struct proc *p = myproc();
+    int r;
+
+    if(mycpu()->ncli > 0)
+        return 0;
+    // A fault from user mode leaves the kernel holding no
+    // pointers into our memory, so kswapd may take from us too.
+    if(err_code & FEC_U)
+        p->swappable = 1;
+    r = swapwait();
+    p->swappable = 0;
+    return r;
+}
+
+// Break the 4 MB page mapped by *pde up into a page table of
+// 1024 read-only 4096-byte pages of it, each holding its own
+// reference, so that copy-on-write copies one small page at a
+// time. Returns 0, or -1 if out of memory.
+static int hugesplit(pde_t *pgdir, pde_t *pde, uint va) {
+    pte_t *pgtab;
+    uint pa, i;
+
+    if((pgtab = (pte_t*)kalloc()) == 0)
+        return -1;
+    pa = PTE_ADDR(*pde);
+    for(i = 0; i < NPTENTRIES; i++) {
+        pgtab[i] = (pa + i*PGSIZE) | (PTE_FLAGS(*pde) & ~PTE_PS);
+        if(i > 0)
+            incrementReferenceCount(pa + i*PGSIZE);
+    }
+    *pde = V2P(pgtab) | PTE_P | PTE_W | PTE_U;
+    tlbinval(pgdir, va);
+    return 0;
+}
+
+// Write fault on a 4 MB page: copy-on-write after fork(). The
+// last sharer just gets it back writable; anyone else splits
+// it and copies the 4096-byte page written to, on the retry.
+static int hugefault(struct proc *p, uint va, int write) {
+    struct vma *v;
+    pde_t *pde;
+
+    pde = &p->pgdir[PDX(va)];
+    v = findvma(p, va);
+    if(!write || v == 0 || !(v->prot & PROT_WRITE))
+        return -1;
+    if(*pde & PTE_W)
         panic("Page fault already writeable");
+
+    if(getReferenceCount(PTE_ADDR(*pde)) == 1) {
+        *pde |= PTE_W;
+        tlbinval(p->pgdir, va);
+    } else if(hugesplit(p->pgdir, pde, va) < 0)
+        return -2;
+    return 0;
+}
+
+// Take one step towards making va accessible to p, for writing
+// if write is set: page it in, unshare its page table, or copy
+// it if shared since fork(). Returns 0 when the access may be
+// retried, -2 if out of memory, or -1 if the access is illegal.
+static int vmfault(struct proc *p, uint va, int write) {
+    pte_t *pte;
+    struct vma *v;
+    uint pa;
+    char *mem;
+    int r;
+
+    if(va < KERNBASE && (p->pgdir[PDX(va)] & PTE_PS))
+        return hugefault(p, va, write);
+
+    // First touch of a demand-paged page, or a swapped-out one.
+    if(va < VDSOBASE && ((pte = walkpgdir(p->pgdir, (void*)va, 0)) == 0 ||
+       !(*pte & PTE_P))) {
+        if((r = pagein(p, va)) != -1)
+            return r;
     }
 
+    // Illegal virtual address. The kernel data pages are
+    // read-only, so any fault on them is one.
+    if(va >= VDSOBASE || (pte = walkpgdir(p->pgdir, (void*)va, 0)) == 0  ||
+       !(*pte & PTE_P) || !(*pte & PTE_U))
+        return -1;
+
+    // Write to an mmap() region without PROT_WRITE.
+    v = findvma(p, va);
+    if(write && v && v->flags && !(v->prot & PROT_WRITE))
+        return -1;
+
+    // Write to a page table shared since fork(): copy the page
+    // table and retry.
+    if(!(p->pgdir[PDX(va)] & PTE_W))
+        return ptunshare(p, va) < 0 ? -2 : 0;
+
+    // Error current page has write permissions enabled
+    if(*pte & PTE_W)
+        panic("Page fault already writeable");
+
     // get the physical address from the  given page table entry
-    uint pa = PTE_ADDR(*pte);
-    // get the reference count of the current page
-    uint refCount = getReferenceCount(pa);
-    char *mem;
+    pa = PTE_ADDR(*pte);
 
     // Current process is the first one that tries to write to this page
-    if(refCount > 1) {
+    if(getReferenceCount(pa) > 1) {
 
         // allocate a new memory page for the process failing if we run out of memory
-        if((mem = kalloc()) == 0) {
-            cprintf("Page fault out of memory, kill proc %s with pid %d\n", myproc()->name, myproc()->pid);
-            myproc()->killed = 1;
-            return;
-        }
+        if((mem = kalloc()) == 0)
+            return -2;
         // copy the contents from the original memory page pointed the virtual address
         memmove(mem, (char*)P2V(pa), PGSIZE);
         // point the given page table entry to the new page
@@ -507,13 +1357,102 @@ void pagefault(uint err_code) {
     }
     // Current process is the last one that tries to write to this page
     // No need to allocate new page as all other process has their copies already
-    else if(refCount == 1) {
+    else if(getReferenceCount(pa) == 1) {
         // remove the read-only restriction on the trapping page
         *pte |= PTE_W;
     } else{
         panic("pagefault reference count wrong\n");
     }
 
-    // Flush TLB for process since page table entries changed
-    lcr3(V2P(myproc()->pgdir));
+    // Flush the stale read-only TLB entry
+    tlbinval(p->pgdir, va);
+    return 0;
+}
+
+//PAGEBREAK!
+// Blank page.
+
+void pagefault(uint err_code) {
+    struct proc *p = myproc();
+
+    // get the faulting virtual address from the CR2 register
+    uint va = rcr2();
+    int r;
+
+    // Error Handling for no user process
+    if(p == 0) {
+        cprintf("Page fault with no user process from cpu %d, cr2=0x%x\n", mycpu()->apicid, va);
+        panic("pagefault");
+    }
+
+    r = vmfault(p, va, err_code & FEC_WR);
+    if(r == 0 || (r == -2 && oomwait(err_code)))
+        return;
+
+    // System calls check and fill in every user buffer with
+    // uvmprefault() first, so the kernel only faults here on a
+    // bug of its own. Going back would just fault again.
+    if(!(err_code & FEC_U)) {
+        cprintf("Kernel page fault on cpu %d addr 0x%x, proc %s with pid %d\n",
+                mycpu()->apicid, va, p->name, p->pid);
+        panic("pagefault");
+    }
+
+    if(r == -2)
+        cprintf("Page fault out of memory, kill proc %s with pid %d\n", p->name, p->pid);
+    else
+        cprintf("Illegal virtual address on cpu %d addr 0x%x, kill proc %s with pid %d\n",
+                mycpu()->apicid, va, p->name, p->pid);
+    // mark the process as killed
+    p->killed = 1;
+}
+
+//PAGEBREAK!
+// Kernel data page.
+//
+// uptime(), getpid(), getNumFreePages() and getpinfo() only read
+// kernel counters, which hardly justifies a trap each. Instead
+// setupkvm() maps one read-only page, vdata, into every page
+// table at VDSOBASE, and ulib reads it directly (see vdso.h).
+// All page tables share one page table page for it, so it costs
+// an address space nothing. vdsotick() brings the counters up to
+// date every tick, switchuvm() records what each CPU is running,
+// and proc.c keeps pinfo in step with the process table. The
+// page is not part of p->sz or any vma, so system calls refuse
+// it as a buffer, mmap() stays below it, and neither fork() nor
+// the swapper ever touches it.
+
+// Allocate the page and its page table. Called once, at boot.
+void vdsoinit(void) {
+    if((vdata = (struct vdata*)kalloc()) == 0 || (vdsopt = (pte_t*)kalloc()) == 0)
+        panic("vdsoinit");
+    memset(vdata, 0, PGSIZE);
+    memset(vdsopt, 0, PGSIZE);
+    vdsopt[PTX(VDSOBASE)] = V2P(vdata) | PTE_P | PTE_U;
+}
+
+// Bring the counters up to date. Called by the timer
+// interrupt on CPU 0, with tickslock held.
+void vdsotick(void) {
+    uint64 now;
+    uint d;
+
+    if(vdata == 0)
+        return;
+    vdata->seq++;
+    __sync_synchronize();
+
+    // Average the cycles per tick over the last few ticks, since
+    // interrupt latency makes any one of them a little off.
+    now = rdtsc();
+    if(vdata->tsc) {
+        d = now - vdata->tsc;
+        vdata->tscpertick = vdata->tscpertick ? (vdata->tscpertick*7 + d) / 8 : d;
+    }
+    vdata->tsc = now;
+    vdata->ticks = ticks;
+    vdata->nfree = getNumFreePages();
+
+    __sync_synchronize();
+    vdata->seq++;
 }
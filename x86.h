@@ -110,6 +110,41 @@ static inline void lcr3(uint val) {
     asm volatile ("movl %0,%%cr3" : : "r" (val));
 }
 
+static inline uint rcr3(void) {
+    uint val;
+    asm volatile ("movl %%cr3,%0" : "=r" (val));
+    return val;
+}
+
+static inline void cpuinfo(uint leaf, uint *eax, uint *ebx, uint *ecx, uint *edx) {
+    asm volatile("cpuid" : "=a" (*eax), "=b" (*ebx), "=c" (*ecx), "=d" (*edx) : "a" (leaf));
+}
+
+static inline void wrmsr(uint msr, uint val) {
+    asm volatile("wrmsr" : : "c" (msr), "a" (val), "d" (0));
+}
+
+// Read the time-stamp counter.
+static inline uint64 rdtsc(void) {
+    uint64 t;
+
+    asm volatile("rdtsc" : "=A" (t));
+    return t;
+}
+
+// Segment limit of the descriptor sel refers to.
+static inline uint lsl(ushort sel) {
+    uint lim;
+
+    asm volatile("lsl %1, %0" : "=r" (lim) : "r" ((uint)sel));
+    return lim;
+}
+
+// Invalidate the TLB entry for the page holding addr.
+static inline void invlpg(void *addr) {
+    asm volatile ("invlpg (%0)" : : "r" (addr) : "memory");
+}
+
 //PAGEBREAK: 36
 // Layout of the trap frame built on the stack by the
 // hardware and by trapasm.S, and passed to trap().